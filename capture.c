@@ -0,0 +1,763 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <picoos.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+
+#if ESHELLCFG_LWIP
+
+#include <picoos-lwip.h>
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+#include "eshell-commands.h"
+
+/*
+ * Ring size and largest snapshot length.
+ */
+#ifndef ESHELLCFG_CAPTURE_SLOTS
+#define ESHELLCFG_CAPTURE_SLOTS 32
+#endif
+
+#ifndef ESHELLCFG_CAPTURE_MAX_SNAPLEN
+#define ESHELLCFG_CAPTURE_MAX_SNAPLEN 1514
+#endif
+
+#define CAPTURE_SNAPLEN   96
+#define CAPTURE_COUNT     20
+
+/*
+ * Bytes needed from start of packet to apply filters,
+ * ethernet + vlan tag + max IP header + ports.
+ */
+#define CAPTURE_HDR_LEN   (18 + 60 + 4)
+
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW      101
+
+#define ETHTYPE_IP4       0x0800
+#define ETHTYPE_VLAN      0x8100
+
+/*
+ * Slot contents must be in memory before
+ * slot is marked ready.
+ */
+#define CAPTURE_BARRIER() __asm__ volatile("" ::: "memory")
+
+#define IPPROTO_ICMP4     1
+#define IPPROTO_TCP4      6
+#define IPPROTO_UDP4      17
+
+enum {
+  CAPTURE_ARG_IF,
+  CAPTURE_ARG_PROTO,
+  CAPTURE_ARG_PORT,
+  CAPTURE_ARG_HOST,
+  CAPTURE_ARG_SNAPLEN,
+  CAPTURE_ARG_COUNT,
+  CAPTURE_ARG_LISTEN,
+  CAPTURE_ARG_STATUS,
+  CAPTURE_ARG_STOP
+};
+
+static const EshArgSpec captureArgs[] = {
+
+  { .name = "if", .type = EshArgString, .flags = ESH_ARG_NAMED, .help = "interface, default is netif_default" },
+  { .name = "proto", .type = EshArgString, .flags = ESH_ARG_NAMED, .help = "only tcp, udp or icmp" },
+  { .name = "port", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 65535, .help = "only this tcp/udp port" },
+  { .name = "host", .type = EshArgIp4, .flags = ESH_ARG_NAMED, .help = "only to or from this address" },
+  { .name = "snaplen", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 20, .max = ESHELLCFG_CAPTURE_MAX_SNAPLEN, .def = CAPTURE_SNAPLEN, .help = "bytes saved per packet" },
+  { .name = "count", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 65535, .def = CAPTURE_COUNT, .help = "packets to show" },
+  { .name = "listen", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 65535, .help = "stream pcap to tcp client on this port" },
+  { .name = "status", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "show capture state" },
+  { .name = "stop", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "stop streaming" },
+  { .name = NULL }
+};
+
+typedef struct __attribute__((packed)) {
+
+  uint32_t magic;
+  uint16_t major;
+  uint16_t minor;
+  int32_t  zone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linkType;
+
+} PcapHeader;
+
+typedef struct __attribute__((packed)) {
+
+  uint32_t sec;
+  uint32_t usec;
+  uint32_t caplen;
+  uint32_t len;
+
+} PcapRecord;
+
+/*
+ * Ring slot. Producer fills everything but pcap
+ * timestamp, which consumer computes from usecs.
+ * Record and data are contiguous, so that slot
+ * can be sent to stream as is.
+ */
+typedef struct {
+
+  volatile bool ready;
+  bool       out;
+  uint32_t   usecs;
+  PcapRecord rec;
+  uint8_t    data[];
+
+} CaptureSlot;
+
+/*
+ * Capture state. Producers are netif input and output
+ * hooks, which may run in different contexts, so they
+ * reserve slots with a short SYS_ARCH_PROTECT section.
+ * Slot contents are copied outside it, writers counts
+ * hooks doing that so that ring is not freed under
+ * them. Single consumer (shell or stream task) takes
+ * slots in order once they are marked ready.
+ */
+typedef struct {
+
+  volatile bool running;
+  volatile bool stop;
+  volatile bool hooked;
+  volatile int writers;
+  struct netif* netif;
+  netif_input_fn input;
+  netif_linkoutput_fn linkoutput;
+  netif_output_fn output;
+  bool     ethernet;
+  uint8_t  proto;
+  uint16_t port;
+  uint32_t host;
+  uint16_t skipPort;
+  uint16_t sessionLocal;
+  uint16_t sessionRemote;
+  uint16_t listenPort;
+  int      snaplen;
+  int      slotSize;
+  uint8_t* ring;
+  volatile uint32_t head;
+  uint32_t tail;
+  uint32_t captured;
+  uint32_t dropped;
+  uint32_t last;
+  uint64_t elapsed;
+
+} Capture;
+
+static Capture cap;
+
+static CaptureSlot* slotAt(uint32_t i)
+{
+  return (CaptureSlot*)(cap.ring + (i % ESHELLCFG_CAPTURE_SLOTS) * cap.slotSize);
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+/*
+ * Locate IPv4 header in packet. Returns offset
+ * or -1 if packet is not IPv4.
+ */
+static int ipOffset(const uint8_t* pkt, int len, bool ethernet)
+{
+  int off = 0;
+  uint16_t type;
+
+  if (ethernet) {
+
+    if (len < 14)
+      return -1;
+
+    type = get16(pkt + 12);
+    off = 14;
+    if (type == ETHTYPE_VLAN && len >= 18) {
+
+      type = get16(pkt + 16);
+      off = 18;
+    }
+
+    if (type != ETHTYPE_IP4)
+      return -1;
+  }
+
+  if (len < off + 20 || (pkt[off] >> 4) != 4)
+    return -1;
+
+  return off;
+}
+
+static bool match(const uint8_t* pkt, int len)
+{
+  int ip;
+  int l4;
+  uint8_t proto;
+  uint16_t sport;
+  uint16_t dport;
+  uint32_t src;
+  uint32_t dst;
+
+  if (cap.proto == 0 && cap.port == 0 && cap.host == 0 && cap.skipPort == 0 && cap.sessionLocal == 0)
+    return true;
+
+  ip = ipOffset(pkt, len, cap.ethernet);
+  if (ip < 0)
+    return cap.proto == 0 && cap.port == 0 && cap.host == 0;
+
+  proto = pkt[ip + 9];
+  if (cap.proto && proto != cap.proto)
+    return false;
+
+  memcpy(&src, pkt + ip + 12, 4);
+  memcpy(&dst, pkt + ip + 16, 4);
+  if (cap.host && src != cap.host && dst != cap.host)
+    return false;
+
+  if (proto != IPPROTO_TCP4 && proto != IPPROTO_UDP4)
+    return cap.port == 0;
+
+  l4 = ip + (pkt[ip] & 0x0f) * 4;
+  if (len < l4 + 4)
+    return cap.port == 0;
+
+  sport = get16(pkt + l4);
+  dport = get16(pkt + l4 + 2);
+  if (proto == IPPROTO_TCP4) {
+
+    if (cap.skipPort && (sport == cap.skipPort || dport == cap.skipPort))
+      return false;
+
+    if (cap.sessionLocal &&
+        ((sport == cap.sessionLocal && dport == cap.sessionRemote) ||
+         (sport == cap.sessionRemote && dport == cap.sessionLocal)))
+      return false;
+  }
+
+  if (cap.port && sport != cap.port && dport != cap.port)
+    return false;
+
+  return true;
+}
+
+/*
+ * Filter and copy packet into ring. Filters look at
+ * first pbuf directly when headers are there,
+ * so rejected packets are not copied at all.
+ */
+static void record(struct pbuf* p, bool out)
+{
+  uint8_t hdr[CAPTURE_HDR_LEN];
+  const uint8_t* pkt;
+  int len;
+  uint32_t i;
+  CaptureSlot* slot;
+
+  if (p->len >= CAPTURE_HDR_LEN || p->len == p->tot_len) {
+
+    pkt = p->payload;
+    len = p->len;
+  }
+  else {
+
+    len = pbuf_copy_partial(p, hdr, sizeof(hdr), 0);
+    pkt = hdr;
+  }
+
+  if (!match(pkt, len))
+    return;
+
+  SYS_ARCH_DECL_PROTECT(lev);
+  SYS_ARCH_PROTECT(lev);
+  if (!cap.hooked) {
+
+    SYS_ARCH_UNPROTECT(lev);
+    return;
+  }
+
+  if (cap.head - cap.tail >= ESHELLCFG_CAPTURE_SLOTS) {
+
+    cap.dropped++;
+    SYS_ARCH_UNPROTECT(lev);
+    return;
+  }
+
+  i = cap.head++;
+  cap.captured++;
+  cap.writers++;
+  SYS_ARCH_UNPROTECT(lev);
+
+  slot = slotAt(i);
+  slot->usecs = eshMicros();
+  slot->out = out;
+  slot->rec.len = p->tot_len;
+  slot->rec.caplen = pbuf_copy_partial(p, slot->data, cap.snaplen, 0);
+  CAPTURE_BARRIER();
+  slot->ready = true;
+
+  SYS_ARCH_PROTECT(lev);
+  cap.writers--;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+static err_t captureInput(struct pbuf* p, struct netif* netif)
+{
+  if (cap.hooked)
+    record(p, false);
+
+  return cap.input(p, netif);
+}
+
+static err_t captureLinkOutput(struct netif* netif, struct pbuf* p)
+{
+  if (cap.hooked)
+    record(p, true);
+
+  return cap.linkoutput(netif, p);
+}
+
+static err_t captureOutput(struct netif* netif, struct pbuf* p, const ip4_addr_t* addr)
+{
+  if (cap.hooked)
+    record(p, true);
+
+  return cap.output(netif, p, addr);
+}
+
+/*
+ * Ethernet interfaces are captured at link level,
+ * others (ppp, slip) at IP level.
+ */
+static void hook(void)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  cap.input = cap.netif->input;
+  cap.netif->input = captureInput;
+  if (cap.ethernet) {
+
+    cap.linkoutput = cap.netif->linkoutput;
+    cap.netif->linkoutput = captureLinkOutput;
+  }
+  else {
+
+    cap.output = cap.netif->output;
+    cap.netif->output = captureOutput;
+  }
+
+  cap.hooked = true;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+static void unhook(void)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  cap.hooked = false;
+  cap.netif->input = cap.input;
+  if (cap.ethernet)
+    cap.netif->linkoutput = cap.linkoutput;
+  else
+    cap.netif->output = cap.output;
+
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/*
+ * Take next ready slot and fill in its timestamp,
+ * relative to capture start.
+ */
+static CaptureSlot* nextSlot(void)
+{
+  CaptureSlot* slot;
+
+  if (cap.tail == cap.head)
+    return NULL;
+
+  slot = slotAt(cap.tail);
+  if (!slot->ready)
+    return NULL;
+
+  CAPTURE_BARRIER();
+  cap.elapsed += (int32_t)(slot->usecs - cap.last);
+  cap.last = slot->usecs;
+
+  slot->rec.sec = cap.elapsed / 1000000;
+  slot->rec.usec = cap.elapsed % 1000000;
+  return slot;
+}
+
+static void releaseSlot(CaptureSlot* slot)
+{
+  slot->ready = false;
+  cap.tail++;
+}
+
+/*
+ * Hooks may still be running on another context
+ * right after unhooking. Once hooked flag is clear
+ * no new copies are started, so wait for ones in
+ * progress before freeing ring.
+ */
+static void captureEnd(void)
+{
+  if (cap.hooked)
+    unhook();
+
+  while (cap.writers > 0)
+    posTaskSleep(1);
+
+  nosMemFree(cap.ring);
+  cap.ring = NULL;
+  cap.running = false;
+}
+
+static void printSummary(EshContext* ctx, const CaptureSlot* slot)
+{
+  const uint8_t* pkt = slot->data;
+  int len = slot->rec.caplen;
+  int ip;
+  int l4;
+  uint8_t proto;
+  struct in_addr src;
+  struct in_addr dst;
+  char srcBuf[16];
+
+  eshPrintf(ctx, "%5u.%06u %-3s ", (unsigned int)slot->rec.sec, (unsigned int)slot->rec.usec, slot->out ? "out" : "in");
+
+  ip = ipOffset(pkt, len, cap.ethernet);
+  if (ip < 0) {
+
+    if (cap.ethernet && len >= 14)
+      eshPrintf(ctx, "ethertype 0x%04x", get16(pkt + 12));
+    else
+      eshPrintf(ctx, "non-ip");
+
+    eshPrintf(ctx, " len %u\n", (unsigned int)slot->rec.len);
+    return;
+  }
+
+  proto = pkt[ip + 9];
+  memcpy(&src.s_addr, pkt + ip + 12, 4);
+  memcpy(&dst.s_addr, pkt + ip + 16, 4);
+  strncpy(srcBuf, inet_ntoa(src), sizeof(srcBuf) - 1);
+  srcBuf[sizeof(srcBuf) - 1] = '\0';
+
+  l4 = ip + (pkt[ip] & 0x0f) * 4;
+  if ((proto == IPPROTO_TCP4 || proto == IPPROTO_UDP4) && len >= l4 + 4) {
+
+    eshPrintf(ctx, "%s %s:%u > %s:%u", proto == IPPROTO_TCP4 ? "tcp" : "udp",
+              srcBuf, get16(pkt + l4), inet_ntoa(dst), get16(pkt + l4 + 2));
+
+    if (proto == IPPROTO_TCP4 && len >= l4 + 14) {
+
+      uint8_t flags = pkt[l4 + 13];
+
+      eshPrintf(ctx, " [%s%s%s%s%s]",
+                flags & 0x02 ? "S" : "", flags & 0x01 ? "F" : "", flags & 0x04 ? "R" : "",
+                flags & 0x08 ? "P" : "", flags & 0x10 ? "." : "");
+    }
+  }
+  else if (proto == IPPROTO_ICMP4 && len >= l4 + 2)
+    eshPrintf(ctx, "icmp %s > %s type %u code %u", srcBuf, inet_ntoa(dst), pkt[l4], pkt[l4 + 1]);
+  else
+    eshPrintf(ctx, "ip proto %u %s > %s", proto, srcBuf, inet_ntoa(dst));
+
+  eshPrintf(ctx, " len %u\n", (unsigned int)slot->rec.len);
+}
+
+static void captureTask(void* arg)
+{
+  int listenSock;
+  int sock;
+  PcapHeader hdr;
+  CaptureSlot* slot;
+  struct sockaddr_in addr;
+  struct timeval tv;
+
+  listenSock = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenSock == -1) {
+
+    captureEnd();
+    return;
+  }
+
+  memset(&addr, '\0', sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(cap.listenPort);
+
+  tv.tv_sec = 0;
+  tv.tv_usec = 200000;
+  setsockopt(listenSock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  if (bind(listenSock, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(listenSock, 1) == -1) {
+
+    closesocket(listenSock);
+    captureEnd();
+    return;
+  }
+
+/*
+ * Wait for client, then start capturing.
+ */
+  sock = -1;
+  while (!cap.stop && sock == -1)
+    sock = accept(listenSock, NULL, NULL);
+
+  closesocket(listenSock);
+  if (sock == -1) {
+
+    captureEnd();
+    return;
+  }
+
+  hdr.magic = 0xa1b2c3d4;
+  hdr.major = 2;
+  hdr.minor = 4;
+  hdr.zone = 0;
+  hdr.sigfigs = 0;
+  hdr.snaplen = cap.snaplen;
+  hdr.linkType = cap.ethernet ? LINKTYPE_ETHERNET : LINKTYPE_RAW;
+
+  if (send(sock, &hdr, sizeof(hdr), 0) == sizeof(hdr)) {
+
+    cap.last = eshMicros();
+    hook();
+    while (!cap.stop) {
+
+      slot = nextSlot();
+      if (slot == NULL) {
+
+        posTaskSleep(1);
+        continue;
+      }
+
+      if (send(sock, &slot->rec, sizeof(PcapRecord) + slot->rec.caplen, 0) < 0)
+        break;
+
+      releaseSlot(slot);
+    }
+  }
+
+  closesocket(sock);
+  captureEnd();
+}
+
+static void captureStatus(EshContext* ctx)
+{
+  if (!cap.running) {
+
+    eshPrintf(ctx, "capture: idle\n");
+    return;
+  }
+
+  eshPrintf(ctx, "capture: %.2s%d, %s, %u captured, %u dropped (ring full)\n",
+            cap.netif->name, cap.netif->num,
+            cap.hooked ? "streaming" : "waiting for client",
+            (unsigned int)cap.captured, (unsigned int)cap.dropped);
+}
+
+static void sessionPorts(int sock)
+{
+  struct sockaddr_in addr;
+  socklen_t len;
+
+  len = sizeof(addr);
+  if (getsockname(sock, (struct sockaddr*)&addr, &len) == -1)
+    return;
+
+  cap.sessionLocal = ntohs(addr.sin_port);
+
+  len = sizeof(addr);
+  if (getpeername(sock, (struct sockaddr*)&addr, &len) == -1) {
+
+    cap.sessionLocal = 0;
+    return;
+  }
+
+  cap.sessionRemote = ntohs(addr.sin_port);
+}
+
+static bool parseProto(EshContext* ctx, const char* proto)
+{
+  if (proto == NULL)
+    cap.proto = 0;
+  else if (!strcmp(proto, "tcp"))
+    cap.proto = IPPROTO_TCP4;
+  else if (!strcmp(proto, "udp"))
+    cap.proto = IPPROTO_UDP4;
+  else if (!strcmp(proto, "icmp"))
+    cap.proto = IPPROTO_ICMP4;
+  else {
+
+    eshPrintf(ctx, "capture: unknown protocol %s.\n", proto);
+    return false;
+  }
+
+  return true;
+}
+
+static int capture(EshContext* ctx)
+{
+  struct netif* netif;
+  char* ifName = ctx->values[CAPTURE_ARG_IF].str;
+  int count;
+  CaptureSlot* slot;
+
+  if (ctx->values[CAPTURE_ARG_STOP].num) {
+
+    cap.stop = true;
+    return 0;
+  }
+
+  if (ctx->values[CAPTURE_ARG_STATUS].num) {
+
+    captureStatus(ctx);
+    return 0;
+  }
+
+  if (cap.running) {
+
+    eshPrintf(ctx, "capture: already running.\n");
+    return -1;
+  }
+
+  netif = ifName ? netif_find(ifName) : netif_default;
+  if (netif == NULL) {
+
+    eshPrintf(ctx, "capture: no interface %s.\n", ifName ? ifName : "");
+    return -1;
+  }
+
+  if (!parseProto(ctx, ctx->values[CAPTURE_ARG_PROTO].str))
+    return -1;
+
+  cap.snaplen = ctx->values[CAPTURE_ARG_SNAPLEN].num;
+  cap.slotSize = (sizeof(CaptureSlot) + cap.snaplen + 3) & ~3;
+  cap.ring = nosMemAlloc(ESHELLCFG_CAPTURE_SLOTS * cap.slotSize);
+  if (cap.ring == NULL) {
+
+    eshPrintf(ctx, "capture: out of memory.\n");
+    return -1;
+  }
+
+  memset(cap.ring, '\0', ESHELLCFG_CAPTURE_SLOTS * cap.slotSize);
+  cap.netif = netif;
+  cap.ethernet = (netif->flags & NETIF_FLAG_ETHERNET) != 0;
+  cap.port = ctx->values[CAPTURE_ARG_PORT].num;
+  cap.host = htonl(ctx->values[CAPTURE_ARG_HOST].ip4);
+  cap.skipPort = 0;
+  cap.sessionLocal = 0;
+  cap.sessionRemote = 0;
+  cap.writers = 0;
+  cap.head = 0;
+  cap.tail = 0;
+  cap.captured = 0;
+  cap.dropped = 0;
+  cap.elapsed = 0;
+  cap.stop = false;
+  cap.hooked = false;
+  cap.running = true;
+
+/*
+ * Leave out telnet session that started capture,
+ * otherwise its own output would be captured
+ * over and over again.
+ */
+  if (ctx->remote)
+    sessionPorts(ctx->telnet.sock);
+
+/*
+ * Streaming runs in its own task. Stream connection
+ * itself is left out of capture.
+ */
+  if (ctx->values[CAPTURE_ARG_LISTEN].present) {
+
+    cap.listenPort = ctx->values[CAPTURE_ARG_LISTEN].num;
+    cap.skipPort = cap.listenPort;
+    if (nosTaskCreate(captureTask, NULL, 2, 1500, "capture") == NULL) {
+
+      eshPrintf(ctx, "capture: failed to create task.\n");
+      captureEnd();
+      return -1;
+    }
+
+    return 0;
+  }
+
+  count = ctx->values[CAPTURE_ARG_COUNT].num;
+  cap.last = eshMicros();
+  hook();
+
+  while (count > 0 && !eshCancelled(ctx)) {
+
+    slot = nextSlot();
+    if (slot == NULL) {
+
+      eshFlush(ctx);
+      posTaskSleep(1);
+      continue;
+    }
+
+    printSummary(ctx, slot);
+    releaseSlot(slot);
+    count--;
+  }
+
+  eshPrintf(ctx, "%u captured, %u dropped (ring full)\n", (unsigned int)cap.captured, (unsigned int)cap.dropped);
+  captureEnd();
+  return 0;
+}
+
+const EshCommand eshCaptureCommand = {
+  .flags = 0,
+  .name = "capture",
+  .help = "capture packets",
+  .handler = capture,
+  .args = captureArgs
+};
+
+#endif
@@ -60,6 +60,8 @@ void eshConsole()
   char buf[80];
   EshContext ctx;
 
+  eshInitCommands();
+
   memset(&ctx, '\0', sizeof(EshContext));
   ctx.output = outputFunc;
   ctx.input  = inputFunc;
@@ -29,12 +29,21 @@
  */
 
 extern const EshCommand eshPingCommand;
+extern const EshCommand eshTracerouteCommand;
+extern const EshCommand eshNetperfCommand;
 extern const EshCommand eshIfconfigCommand;
+extern const EshCommand eshNetmemCommand;
+extern const EshCommand eshNetstatCommand;
+extern const EshCommand eshCaptureCommand;
 extern const EshCommand eshHelpCommand;
 extern const EshCommand eshExitCommand;
 extern const EshCommand eshTsCommand;
 extern const EshCommand eshEsCommand;
+extern const EshCommand eshTopCommand;
+extern const EshCommand eshProfCommand;
+extern const EshCommand eshTraceCommand;
 extern const EshCommand eshOnewireCommand;
+extern const EshCommand eshTelnetdCommand;
 
 /*
  * Application should define this.
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ESHELL_HOOKS_H
+#define ESHELL_HOOKS_H
+
+#include <picoos.h>
+#include "eshellcfg.h"
+
+/*
+ * Hooks that application or port calls for eshell
+ * to collect runtime statistics. These need pico]OS
+ * types, so they are kept out of eshell.h.
+ */
+
+#if ESHELLCFG_TOP
+/*
+ * CPU accounting hooks for top command. eshTopTick
+ * should be called from timer interrupt, eshTopSwitch
+ * (if ESHELLCFG_TOP_SWITCH_HOOK is set) when
+ * scheduler switches to next task.
+ */
+void  eshTopTick(void);
+void  eshTopSwitch(POSTASK_t next);
+#endif
+
+#if ESHELLCFG_EVENT_STATS
+/*
+ * Wrappers that collect contention statistics
+ * for es --stats. Destroy wrappers free statistics
+ * slot of event.
+ */
+void  eshMutexLock(POSMUTEX_t mutex);
+void  eshMutexUnlock(POSMUTEX_t mutex);
+void  eshMutexDestroy(POSMUTEX_t mutex);
+void  eshSemaGet(POSSEMA_t sema);
+void  eshSemaDestroy(POSSEMA_t sema);
+#endif
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ESHELL_TRACE_H
+#define ESHELL_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "eshellcfg.h"
+
+/*
+ * Binary trace ring buffer. ESH_TRACE() stores a timestamped
+ * record of event id and two arguments. Slot is reserved
+ * with a single atomic increment (ldrex/strex on Cortex-M3 and
+ * up), so macro can be used from tasks and interrupts without
+ * locking. Cores without atomic instructions (Cortex-M0,
+ * MSP430) reserve slot with interrupts briefly disabled
+ * instead. When ring is full, oldest records are overwritten.
+ * Records are dumped with trace command.
+ *
+ * Ids below ESH_TRACE_USER are reserved for eshell, application
+ * can use ids starting from it.
+ */
+
+#ifndef ESHELLCFG_TRACE
+#define ESHELLCFG_TRACE 0
+#endif
+
+#define ESH_TRACE_SWITCH    1
+#define ESH_TRACE_CMD_START 2
+#define ESH_TRACE_CMD_END   3
+#define ESH_TRACE_USER      0x100
+
+#if ESHELLCFG_TRACE
+
+/*
+ * Number of records, must be power of two.
+ */
+#ifndef ESHELLCFG_TRACE_SIZE
+#define ESHELLCFG_TRACE_SIZE 256
+#endif
+
+/*
+ * Timestamp source. Application can replace this
+ * with something faster, like a cycle counter.
+ */
+#ifndef ESHELLCFG_TRACE_CLOCK
+#define ESHELLCFG_TRACE_CLOCK() eshMicros()
+#endif
+
+#if ESHELLCFG_TRACE_SIZE & (ESHELLCFG_TRACE_SIZE - 1)
+#error ESHELLCFG_TRACE_SIZE must be power of two
+#endif
+
+/*
+ * Use atomic increment if compiler can do it inline,
+ * otherwise it would need library support that small
+ * cores don't have.
+ */
+#ifndef ESHELLCFG_TRACE_ATOMIC
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_4)
+#define ESHELLCFG_TRACE_ATOMIC 1
+#else
+#define ESHELLCFG_TRACE_ATOMIC 0
+#endif
+#endif
+
+#if !ESHELLCFG_TRACE_ATOMIC
+#include <picoos.h>
+#endif
+
+typedef struct {
+
+  uint32_t stamp;
+  uint32_t id;
+  uint32_t arg1;
+  uint32_t arg2;
+
+} EshTraceRecord;
+
+typedef struct {
+
+  volatile bool  enabled;
+  volatile uint32_t head;
+  EshTraceRecord buf[ESHELLCFG_TRACE_SIZE];
+
+} EshTrace;
+
+extern EshTrace eshTrace;
+uint32_t eshMicros(void);
+
+static inline uint32_t eshTraceNext(void)
+{
+#if ESHELLCFG_TRACE_ATOMIC
+  return __atomic_fetch_add(&eshTrace.head, 1, __ATOMIC_RELAXED);
+#else
+  uint32_t i;
+  POS_LOCKFLAGS;
+
+  POS_SCHED_LOCK;
+  i = eshTrace.head++;
+  POS_SCHED_UNLOCK;
+  return i;
+#endif
+}
+
+#define ESH_TRACE(i, a1, a2) do {                                          \
+  if (eshTrace.enabled) {                                                  \
+    EshTraceRecord* r_ = &eshTrace.buf[eshTraceNext() & (ESHELLCFG_TRACE_SIZE - 1)]; \
+    r_->stamp = ESHELLCFG_TRACE_CLOCK();                                   \
+    r_->id = (i);                                                          \
+    r_->arg1 = (uint32_t)(uintptr_t)(a1);                                  \
+    r_->arg2 = (uint32_t)(uintptr_t)(a2);                                  \
+  }                                                                        \
+} while (0)
+
+#else
+
+/*
+ * Arguments are not evaluated, but still count as used.
+ */
+#define ESH_TRACE(i, a1, a2) do { if (0) { (void)(i); (void)(a1); (void)(a2); } } while (0)
+
+#endif
+
+/*
+ * pico]OS has no hook for context switches, so task switches
+ * are recorded only if port calls this when scheduler
+ * switches to next task (for example from context switch
+ * code, with next task handle).
+ */
+#define ESH_TRACE_TASK_SWITCH(next) ESH_TRACE(ESH_TRACE_SWITCH, next, 0)
+
+#endif
@@ -32,21 +32,29 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdarg.h>
 
 #include "eshell.h"
 #include "eshell-commands.h"
+#include "eshell-trace.h"
 
 static int help(EshContext* ctx);
 static int exitShell(EshContext* ctx);
 
+const EshArgSpec eshNoArgs[] = {
+
+  { .name = NULL }
+};
+
 const EshCommand eshHelpCommand = {
 
   .flags = 0,
   .name = "help",
   .help = "displays help",
-  .handler = help
+  .handler = help,
+  .args = eshNoArgs
 };
 
 const EshCommand eshExitCommand = {
@@ -54,9 +62,20 @@ const EshCommand eshExitCommand = {
   .flags = ESH_FLAG_REMOTE,
   .name = "exit",
   .help = "exit shell",
-  .handler = exitShell
+  .handler = exitShell,
+  .args = eshNoArgs
 };
 
+/*
+ * Command lookup index. Contains pointers to eshCommandList
+ * slots, sorted by command name. Built once, either by
+ * eshInitCommands() or on first eshParse(), and sized
+ * from actual command list.
+ */
+static const EshCommand*** commandIndex;
+static int commandIndexCount = 0;
+static bool commandIndexReady = false;
+
 static bool commandVisible(EshContext*ctx, const EshCommand* cmd)
 {
   if (cmd->flags == 0)
@@ -71,28 +90,445 @@ static bool commandVisible(EshContext*ctx, const EshCommand* cmd)
   return false;
 }
 
+static int compareCommands(const void* a, const void* b)
+{
+  const EshCommand** const* ca = a;
+  const EshCommand** const* cb = b;
+  int diff;
+
+  diff = strcmp((**ca)->name, (**cb)->name);
+  if (diff != 0)
+    return diff;
+
+/*
+ * Keep commands with same name in list order.
+ */
+  if (*ca < *cb)
+    return -1;
+
+  return (*ca > *cb) ? 1 : 0;
+}
+
+/*
+ * Build command lookup index. eshConsole() and eshStartTelnetd()
+ * call this before serving any sessions, so index is not
+ * built concurrently by multiple tasks.
+ */
+void eshInitCommands()
+{
+  const EshCommand** cmd;
+  int count = 0;
+
+  if (commandIndexReady)
+    return;
+
+  for (cmd = eshCommandList; *cmd != NULL; cmd++) {
+
+    count++;
+
+/*
+ * Argument values are stored in fixed size table,
+ * parseArgs refuses to run commands with larger schema.
+ */
+    if ((*cmd)->args != NULL) {
+
+      const EshArgSpec* spec;
+
+      for (spec = (*cmd)->args; spec->name != NULL; spec++)
+        ;
+
+      if (spec - (*cmd)->args > MAX_ARG_SPECS)
+        printf("eshell: %s: argument schema has more than %d entries.\n", (*cmd)->name, MAX_ARG_SPECS);
+    }
+  }
+
+  if (count > 0) {
+
+    commandIndex = malloc(count * sizeof(commandIndex[0]));
+    if (commandIndex == NULL) {
+
+      printf("eshell: no memory for command index, using linear search.\n");
+      count = -1;
+    }
+  }
+
+  if (count > 0) {
+
+    count = 0;
+    for (cmd = eshCommandList; *cmd != NULL; cmd++)
+      commandIndex[count++] = cmd;
+
+    qsort(commandIndex, count, sizeof(commandIndex[0]), compareCommands);
+  }
+
+  commandIndexCount = count;
+  commandIndexReady = true;
+}
+
+static const EshCommand* findCommand(EshContext* ctx, const char* name)
+{
+  const EshCommand** cmd;
+  int low;
+  int high;
+  int mid;
+
+  eshInitCommands();
+
+/*
+ * Fall back to linear search if there was no
+ * memory for index.
+ */
+  if (commandIndexCount < 0) {
+
+    for (cmd = eshCommandList; *cmd != NULL; cmd++)
+      if (commandVisible(ctx, *cmd) && !strcmp((*cmd)->name, name))
+        return *cmd;
+
+    return NULL;
+  }
+
+/*
+ * Binary search for first entry with matching name.
+ */
+  low = 0;
+  high = commandIndexCount;
+  while (low < high) {
+
+    mid = (low + high) / 2;
+    if (strcmp((*commandIndex[mid])->name, name) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+/*
+ * There might be multiple commands with same name
+ * but different visibility.
+ */
+  for (; low < commandIndexCount; low++) {
+
+    cmd = commandIndex[low];
+    if (strcmp((*cmd)->name, name))
+      break;
+
+    if (commandVisible(ctx, *cmd))
+      return *cmd;
+  }
+
+  return NULL;
+}
+
 bool eshPrompt(EshContext*ctx, const char* prompt, char* buf, int max)
 {
+  eshFlush(ctx);
   ctx->output(ctx, prompt);
   return ctx->input(ctx, buf, max - 1);
 }
 
+void eshFlush(EshContext* ctx)
+{
+  if (ctx->out.len == 0)
+    return;
+
+  ctx->out.buf[ctx->out.len] = '\0';
+  ctx->out.len = 0;
+  ctx->output(ctx, ctx->out.buf);
+}
+
+/*
+ * Append text to output buffer, passing buffer
+ * to transport each time it fills up.
+ */
+static void outWrite(EshContext* ctx, const char* str, int len)
+{
+  int room;
+
+#if ESHELLCFG_OUTPUT_LINE_FLUSH
+  bool newline = memchr(str, '\n', len) != NULL;
+#endif
+
+  while (len > 0) {
+
+/*
+ * Leave space for terminating nul added by eshFlush.
+ */
+    room = sizeof(ctx->out.buf) - 1 - ctx->out.len;
+    if (room == 0) {
+
+      eshFlush(ctx);
+      continue;
+    }
+
+    if (room > len)
+      room = len;
+
+    memcpy(ctx->out.buf + ctx->out.len, str, room);
+    ctx->out.len += room;
+    str += room;
+    len -= room;
+  }
+
+#if ESHELLCFG_OUTPUT_LINE_FLUSH
+  if (newline)
+    eshFlush(ctx);
+#endif
+}
+
+static void outPad(EshContext* ctx, int count)
+{
+  static const char spaces[] = "                ";
+  int n;
+
+  while (count > 0) {
+
+    n = count < (int)sizeof(spaces) - 1 ? count : (int)sizeof(spaces) - 1;
+    outWrite(ctx, spaces, n);
+    count -= n;
+  }
+}
+
+static int parseNum(const char** p)
+{
+  int num = 0;
+
+  while (**p >= '0' && **p <= '9') {
+
+    num = num * 10 + **p - '0';
+    (*p)++;
+  }
+
+  return num;
+}
+
+/*
+ * Formatted output. Format is processed one conversion at
+ * a time, so output of any length is streamed through output
+ * buffer without temporary allocations. Strings are copied
+ * directly from argument, other conversions are formatted by
+ * snprintf into a FORMAT_STEP sized buffer, which limits
+ * their width.
+ */
+#define FORMAT_STEP 64
+
 void eshPrintf(EshContext*ctx, const char* fmt, ...)
 {
   va_list ap;
-  char buf[80];
+  const char* p = fmt;
+  const char* start;
+  const char* flags;
+  const char* length;
+  int flagsLen;
+  int lengthLen;
+  int width;
+  int prec;
+  bool left;
+  char conv;
+  char spec[24];
+  char buf[FORMAT_STEP];
+  const char* str;
+  int len;
 
   va_start(ap, fmt);
-  vsnprintf(buf, sizeof(buf), fmt, ap);
-  ctx->output(ctx, buf);
+  while (*p != '\0') {
+
+    start = p;
+    while (*p != '\0' && *p != '%')
+      p++;
+
+    outWrite(ctx, start, p - start);
+    if (*p == '\0')
+      break;
+
+    start = p++;
+    if (*p == '%') {
+
+      outWrite(ctx, p++, 1);
+      continue;
+    }
+
+    left = false;
+    flags = p;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) {
+
+      if (*p == '-')
+        left = true;
+
+      p++;
+    }
+
+    flagsLen = p - flags;
+
+    width = -1;
+    if (*p == '*') {
+
+      p++;
+      width = va_arg(ap, int);
+      if (width < 0) {
+
+        left = true;
+        width = -width;
+      }
+    }
+    else if (*p >= '0' && *p <= '9')
+      width = parseNum(&p);
+
+    prec = -1;
+    if (*p == '.') {
+
+      p++;
+      if (*p == '*') {
+
+        p++;
+        prec = va_arg(ap, int);
+      }
+      else
+        prec = parseNum(&p);
+    }
+
+    length = p;
+    while (*p != '\0' && strchr("hlLzjtq", *p) != NULL)
+      p++;
+
+    lengthLen = p - length;
+    conv = *p;
+    if (conv == '\0' || flagsLen > 5 || lengthLen > 2) {
+
+      outWrite(ctx, start, strlen(start));
+      break;
+    }
+
+    p++;
+
+/*
+ * Strings are streamed, padding is added here.
+ */
+    if (conv == 's') {
+
+      str = va_arg(ap, const char*);
+      if (str == NULL)
+        str = "(null)";
+
+      if (prec >= 0)
+        len = strnlen(str, prec);
+      else
+        len = strlen(str);
+
+      if (!left && width > len)
+        outPad(ctx, width - len);
+
+      outWrite(ctx, str, len);
+
+      if (left && width > len)
+        outPad(ctx, width - len);
+
+      continue;
+    }
+
+/*
+ * Rebuild conversion with width and precision
+ * taken from arguments and format it.
+ */
+    len = sprintf(spec, "%%%.*s", flagsLen, flags);
+    if (width >= 0)
+      len += sprintf(spec + len, "%d", width < FORMAT_STEP ? width : FORMAT_STEP - 1);
+
+    if (prec >= 0)
+      len += sprintf(spec + len, ".%d", prec < FORMAT_STEP ? prec : FORMAT_STEP - 1);
+
+    sprintf(spec + len, "%.*s%c", lengthLen, length, conv);
+
+    switch (conv) {
+    case 'd':
+    case 'i':
+      if (lengthLen == 2 && length[0] == 'l')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, long long));
+      else if (lengthLen == 1 && *length == 'l')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, long));
+      else if (lengthLen == 1 && *length == 'z')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, size_t));
+      else if (lengthLen == 1 && *length == 'j')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, intmax_t));
+      else if (lengthLen == 1 && *length == 't')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, ptrdiff_t));
+      else
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, int));
+      break;
+
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+      if (lengthLen == 2 && length[0] == 'l')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, unsigned long long));
+      else if (lengthLen == 1 && *length == 'l')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, unsigned long));
+      else if (lengthLen == 1 && *length == 'z')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, size_t));
+      else if (lengthLen == 1 && *length == 'j')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, uintmax_t));
+      else if (lengthLen == 1 && *length == 't')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, ptrdiff_t));
+      else
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, unsigned int));
+      break;
+
+    case 'c':
+      len = snprintf(buf, sizeof(buf), spec, va_arg(ap, int));
+      break;
+
+    case 'p':
+      len = snprintf(buf, sizeof(buf), spec, va_arg(ap, void*));
+      break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      if (lengthLen == 1 && *length == 'L')
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, long double));
+      else
+        len = snprintf(buf, sizeof(buf), spec, va_arg(ap, double));
+      break;
+
+    default:
+      outWrite(ctx, start, p - start);
+      continue;
+    }
+
+    if (len >= (int)sizeof(buf))
+      len = sizeof(buf) - 1;
+
+    if (len > 0)
+      outWrite(ctx, buf, len);
+  }
+
   va_end(ap);
 }
 
+/*
+ * Long-running commands should call this periodically
+ * and stop when it returns true. Transport poll function
+ * checks if user has requested interrupt.
+ */
+bool eshCancelled(EshContext* ctx)
+{
+  if (!ctx->cancelled && ctx->poll != NULL)
+    ctx->poll(ctx);
+
+  return ctx->cancelled;
+}
+
 EshStatus eshArgError(EshContext* ctx)
 {
   return ctx->error;
 }
 
+#define ARG_BIT(i) (1UL << (i))
+
 void eshCheckArgsUsed(EshContext* ctx)
 {
   int i;
@@ -100,12 +536,17 @@ void eshCheckArgsUsed(EshContext* ctx)
   if (ctx->error != EshOK)
     return;
 
-  if (ctx->argc == 1)
+  for (i = ctx->args.named + 1; i < ctx->argc; i++)
+    if (!(ctx->args.used & ARG_BIT(i)))
+      break;
+
+  if (i >= ctx->argc)
     return;
 
   eshPrintf(ctx, "%s: unknown parameter(s):", ctx->argv[0]);
-  for (i = 1; i < ctx->argc; i++)
-    eshPrintf(ctx, " %s", ctx->argv[i]);
+  for (; i < ctx->argc; i++)
+    if (!(ctx->args.used & ARG_BIT(i)))
+      eshPrintf(ctx, " %s", ctx->argv[i]);
 
   eshPrintf(ctx, "\n");
   ctx->error = EshUnknownArg;
@@ -118,16 +559,16 @@ void eshCheckNamedArgsUsed(EshContext* ctx)
   if (ctx->error != EshOK)
     return;
 
-  for (i = 1; i < ctx->argc; i++)
-    if (!strncmp(ctx->argv[i], "--", 2))
+  for (i = 1; i <= ctx->args.named; i++)
+    if (!(ctx->args.used & ARG_BIT(i)))
       break;
 
-  if (i >= ctx->argc)
+  if (i > ctx->args.named)
     return;
 
   eshPrintf(ctx, "%s: unknown parameter(s):", ctx->argv[0]);
-  for (i = 1; i < ctx->argc; i++)
-    if (!strncmp(ctx->argv[i], "--", 2))
+  for (; i <= ctx->args.named; i++)
+    if (!(ctx->args.used & ARG_BIT(i)))
       eshPrintf(ctx, " %s", ctx->argv[i]);
 
   eshPrintf(ctx, "\n");
@@ -137,25 +578,15 @@ void eshCheckNamedArgsUsed(EshContext* ctx)
 char* eshNextArg(EshContext* ctx, bool must)
 {
   int i;
-  char* arg;
 
   if (ctx->error != EshOK)
     return NULL;
 
-/*
- * Search for argument.
- */
-  for (i = 1; i < ctx->argc; i++) {
-
-    arg = ctx->argv[i];
-    if (strncmp(arg, "--", 2)) {
+  if (ctx->args.next < ctx->argc) {
 
-      if (i < ctx->argc - 1)
-        memmove(ctx->argv + i, ctx->argv + i + 1, sizeof(char*) * (ctx->argc - i - 1));
-
-      ctx->argc--;
-      return arg;
-    }
+    i = ctx->args.next++;
+    ctx->args.used |= ARG_BIT(i);
+    return ctx->argv[i];
   }
 
   if (must)
@@ -167,8 +598,7 @@ char* eshNextArg(EshContext* ctx, bool must)
 char* eshNamedArg(EshContext* ctx, const char* name, bool must)
 {
   int i;
-  char* sep;
-  int   len;
+  int len;
   char* arg;
 
   if (ctx->error != EshOK)
@@ -177,65 +607,292 @@ char* eshNamedArg(EshContext* ctx, const char* name, bool must)
 /*
  * Search for argument.
  */
+  len = strlen(name);
+  for (i = 1; i <= ctx->args.named; i++) {
 
-  for (i = 1; i < ctx->argc; i++) {
+    arg = ctx->argv[i] + 2;
+    if (ctx->args.nameLen[i] != len || strncmp(name, arg, len))
+      continue;
 
-    arg = ctx->argv[i];
-    if (!strncmp(arg, "--", 2)) {
+    ctx->args.used |= ARG_BIT(i);
+    if (ctx->args.dup & ARG_BIT(i)) {
 
-      arg = arg + 2;
-      sep = strchr(arg, '=');
-      if (sep != NULL)
-        len = sep - arg;
-      else
-        len = strlen(arg);
+      eshPrintf(ctx, "%s: --%s specified multiple times.\n", ctx->argv[0], name);
+      ctx->error = EshDuplicateArg;
+      return NULL;
+    }
 
-      if (!strncmp(name, arg, len)) {
+    arg = arg + len;
+    if (*arg == '\0')
+      return arg;
 
-        if (i < ctx->argc - 1)
-          memmove(ctx->argv + i, ctx->argv + 2, sizeof(char*) * (ctx->argc - i - 1));
+    ++arg;
+    if (*arg == '\0') {
 
-        ctx->argc--;
-        if (sep != NULL) {
+      eshPrintf(ctx, "%s: --%s: missing argument value .\n", ctx->argv[0], name);
+      ctx->error = EshBadArg;
+      return NULL;
+    }
 
-          arg = sep + 1;
-          if (strlen(arg) == 0) {
+    return arg;
+  }
 
-            eshPrintf(ctx, "%s: --%s: missing argument value .\n", ctx->argv[0], name);
-            ctx->error = EshBadArg;
-            return NULL;
-          }
-        }
-        else
-          arg = "";
+  if (must) {
 
-        if (eshNamedArg(ctx, name, false) != NULL) {
+    ctx->error = EshMissingArg;
+  }
 
-          eshPrintf(ctx, "%s: --%s specified multiple times.\n", ctx->argv[0], name);
-          ctx->error = EshDuplicateArg;
-          return NULL;
-        }
+  return NULL;
+}
 
-        return arg;
-      }
+/*
+ * Add named argument to index. If same name has
+ * been seen earlier, mark first occurrence as duplicate.
+ */
+static void indexNamedArg(EshContext* ctx, int pos)
+{
+  char* name = ctx->argv[pos] + 2;
+  char* sep;
+  int   len;
+  int   i;
+
+  sep = strchr(name, '=');
+  if (sep != NULL)
+    len = sep - name;
+  else
+    len = strlen(name);
+
+  ctx->args.nameLen[pos] = len;
+  ctx->args.named = pos;
+
+  for (i = 1; i < pos; i++) {
+
+    if (ctx->args.nameLen[i] == len && !strncmp(ctx->argv[i] + 2, name, len)) {
+
+      ctx->args.dup |= ARG_BIT(i);
+      break;
     }
   }
+}
 
-  if (must) {
+static const char* argTypeName(EshArgType type)
+{
+  switch (type) {
+  case EshArgInt:
+    return "int";
 
-    ctx->error = EshMissingArg;
+  case EshArgBool:
+    return "bool";
+
+  case EshArgIp4:
+    return "ip4";
+
+  default:
+    return "string";
+  }
+}
+
+static void argUsage(EshContext* ctx, const EshArgSpec* spec)
+{
+  char buf[40];
+
+  if (spec->flags & ESH_ARG_LIST)
+    snprintf(buf, sizeof(buf), "<%s> ...", spec->name);
+  else if (!(spec->flags & ESH_ARG_NAMED))
+    snprintf(buf, sizeof(buf), "<%s>", spec->name);
+  else if (spec->type == EshArgBool)
+    snprintf(buf, sizeof(buf), "--%s", spec->name);
+  else
+    snprintf(buf, sizeof(buf), "--%s=<%s>", spec->name, argTypeName(spec->type));
+
+  eshPrintf(ctx, "  %-22s", buf);
+  if (spec->help != NULL)
+    eshPrintf(ctx, " %s", spec->help);
+
+  if (spec->type == EshArgInt) {
+
+    if (spec->min < spec->max)
+      eshPrintf(ctx, " [%d..%d]", spec->min, spec->max);
+
+    if (!(spec->flags & ESH_ARG_REQUIRED))
+      eshPrintf(ctx, " (default %d)", spec->def);
   }
 
-  return NULL;
+  if (spec->flags & ESH_ARG_REQUIRED)
+    eshPrintf(ctx, " (required)");
+
+  eshPrintf(ctx, "\n");
 }
 
-static void usage(EshContext* ctx, const EshCommand* cmd)
+static void usage(EshContext* ctx, const EshCommand* cmd, bool verbose)
 {
+  const EshArgSpec* spec;
+
   eshPrintf(ctx, "%-20s", cmd->name);
   if (cmd->help != NULL)
     eshPrintf(ctx, " %s", cmd->help);
 
   eshPrintf(ctx, "\n");
+  if (!verbose || cmd->args == NULL)
+    return;
+
+  for (spec = cmd->args; spec->name != NULL; spec++)
+    argUsage(ctx, spec);
+}
+
+static bool parseIp4(const char* str, uint32_t* addr)
+{
+  int i;
+  unsigned long part;
+  char* end;
+
+  *addr = 0;
+  for (i = 0; i < 4; i++) {
+
+    if (*str < '0' || *str > '9')
+      return false;
+
+    part = strtoul(str, &end, 10);
+    if (part > 255)
+      return false;
+
+    *addr = (*addr << 8) | part;
+    if (i < 3 && *end != '.')
+      return false;
+
+    str = end + 1;
+  }
+
+  return *end == '\0';
+}
+
+static bool parseBool(const char* str, int* value)
+{
+  if (*str == '\0' || !strcmp(str, "1") || !strcmp(str, "yes") ||
+      !strcmp(str, "on") || !strcmp(str, "true")) {
+
+    *value = 1;
+    return true;
+  }
+
+  if (!strcmp(str, "0") || !strcmp(str, "no") ||
+      !strcmp(str, "off") || !strcmp(str, "false")) {
+
+    *value = 0;
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * Convert argument text according to its schema entry.
+ */
+static void convertArg(EshContext* ctx, const EshArgSpec* spec, EshArgValue* val)
+{
+  const char* prefix = (spec->flags & ESH_ARG_NAMED) ? "--" : "";
+  long num;
+  char* end;
+
+  if (spec->type != EshArgBool && *val->str == '\0') {
+
+    eshPrintf(ctx, "%s: %s%s: missing argument value.\n", ctx->argv[0], prefix, spec->name);
+    ctx->error = EshBadArg;
+    return;
+  }
+
+  switch (spec->type) {
+  case EshArgString:
+    break;
+
+  case EshArgInt:
+    num = strtol(val->str, &end, 0);
+    if (*end != '\0') {
+
+      eshPrintf(ctx, "%s: %s%s: %s is not a number.\n", ctx->argv[0], prefix, spec->name, val->str);
+      ctx->error = EshBadArg;
+      return;
+    }
+
+    if (spec->min < spec->max && (num < spec->min || num > spec->max)) {
+
+      eshPrintf(ctx, "%s: %s%s: value must be between %d and %d.\n", ctx->argv[0], prefix, spec->name, spec->min, spec->max);
+      ctx->error = EshBadArg;
+      return;
+    }
+
+    val->num = num;
+    break;
+
+  case EshArgBool:
+    if (!parseBool(val->str, &val->num)) {
+
+      eshPrintf(ctx, "%s: %s%s: %s is not a boolean.\n", ctx->argv[0], prefix, spec->name, val->str);
+      ctx->error = EshBadArg;
+    }
+
+    break;
+
+  case EshArgIp4:
+    if (!parseIp4(val->str, &val->ip4)) {
+
+      eshPrintf(ctx, "%s: %s%s: %s is not an ip4 address.\n", ctx->argv[0], prefix, spec->name, val->str);
+      ctx->error = EshBadArg;
+    }
+
+    break;
+  }
+}
+
+/*
+ * Validate and convert all arguments of command
+ * that has an argument schema.
+ */
+static void parseArgs(EshContext* ctx, const EshCommand* cmd)
+{
+  const EshArgSpec* spec;
+  EshArgValue* val;
+  bool must;
+  bool list = false;
+
+  for (spec = cmd->args, val = ctx->values; spec->name != NULL; spec++, val++) {
+
+    if (val == ctx->values + MAX_ARG_SPECS) {
+
+      eshPrintf(ctx, "%s: too many arguments in schema.\n", ctx->argv[0]);
+      ctx->error = EshBadArg;
+      return;
+    }
+
+    must = (spec->flags & ESH_ARG_REQUIRED) != 0;
+
+    val->present = false;
+    val->num = spec->def;
+    val->ip4 = 0;
+
+    if (spec->flags & ESH_ARG_NAMED)
+      val->str = eshNamedArg(ctx, spec->name, must);
+    else
+      val->str = eshNextArg(ctx, must);
+
+    if (ctx->error != EshOK)
+      return;
+
+    if (val->str == NULL)
+      continue;
+
+    val->present = true;
+    convertArg(ctx, spec, val);
+    if (ctx->error != EshOK)
+      return;
+
+    if (spec->flags & ESH_ARG_LIST)
+      list = true;
+  }
+
+  eshCheckNamedArgsUsed(ctx);
+  if (!list)
+    eshCheckArgsUsed(ctx);
 }
 
 static int help(EshContext* ctx)
@@ -244,7 +901,7 @@ static int help(EshContext* ctx)
 
   for (cmd = eshCommandList; *cmd != NULL; cmd++)
     if (commandVisible(ctx, *cmd))
-      usage(ctx, *cmd);
+      usage(ctx, *cmd, false);
 
   return 0;
 }
@@ -255,7 +912,7 @@ static int exitShell(EshContext* ctx)
   return 0;
 }
 
-int eshParse(EshContext* ctx, char* buf)
+static int parseLine(EshContext* ctx, char* buf)
 {
   char* cmdName;
   char* argStr;
@@ -263,6 +920,9 @@ int eshParse(EshContext* ctx, char* buf)
   ctx->error = EshOK;
   ctx->argc = 0;
   ctx->command = NULL;
+  ctx->args.named = 0;
+  ctx->args.used = 0;
+  ctx->args.dup = 0;
 
   do {
 
@@ -272,22 +932,16 @@ int eshParse(EshContext* ctx, char* buf)
 
   } while (*cmdName == '\0');
 
-  const EshCommand** cmd;
-
-  for (cmd = eshCommandList; *cmd != NULL; cmd++) {
-
-    if (commandVisible(ctx, *cmd))
-      if (!strcmp((*cmd)->name, cmdName))
-        break;
-  }
+  const EshCommand* cmd;
 
-  if (*cmd == NULL) {
+  cmd = findCommand(ctx, cmdName);
+  if (cmd == NULL) {
 
     eshPrintf(ctx, "%s: Unknown command, try help.\n", cmdName);
     return -1;
   }
 
-  ctx->command = *cmd;
+  ctx->command = cmd;
   ctx->argv[ctx->argc++] = cmdName;
   bool positionalArgSeen = false;
 
@@ -311,18 +965,36 @@ int eshParse(EshContext* ctx, char* buf)
       return -1;
     }
 
-    ctx->argv[ctx->argc++] = argStr;
+    ctx->argv[ctx->argc] = argStr;
+    if (!positionalArgSeen)
+      indexNamedArg(ctx, ctx->argc);
+
+    ctx->argc++;
   }
-  
+
+  ctx->args.next = ctx->args.named + 1;
+
   char* help = eshNamedArg(ctx, "help", false);
   if (help != NULL && strlen(help) == 0) {
 
-    usage(ctx, *cmd);
+    usage(ctx, cmd, true);
     return 1;
   }
   else {
 
-    (*cmd)->handler(ctx);
+    if (cmd->args != NULL)
+      parseArgs(ctx, cmd);
+
+    if (ctx->error == EshOK) {
+
+      ctx->cancelled = false;
+      ESH_TRACE(ESH_TRACE_CMD_START, cmd, 0);
+      int status = cmd->handler(ctx);
+      ESH_TRACE(ESH_TRACE_CMD_END, cmd, status);
+      if (ctx->cancelled)
+        eshPrintf(ctx, "\n%s: interrupted.\n", ctx->argv[0]);
+    }
+
     switch (ctx->error) {
     case EshQuit:
       return 0;
@@ -346,3 +1018,12 @@ int eshParse(EshContext* ctx, char* buf)
     return 1;
   }
 }
+
+int eshParse(EshContext* ctx, char* buf)
+{
+  int status;
+
+  status = parseLine(ctx, buf);
+  eshFlush(ctx);
+  return status;
+}
@@ -32,6 +32,36 @@
 
 #define MAX_ARGS	10
 
+/*
+ * Max entries in command argument schema. Commands
+ * may have more options than fit on one line.
+ */
+#define MAX_ARG_SPECS	16
+
+/*
+ * Size of per-context output buffer. eshPrintf output
+ * is collected here and passed to transport when buffer
+ * fills up, at end of command or by eshFlush().
+ * If ESHELLCFG_OUTPUT_LINE_FLUSH is set, buffer is flushed
+ * also after each newline. It is off by default, as it
+ * would cost one transport write per listing row. Commands
+ * that print progress periodically call eshFlush() instead.
+ */
+#ifndef ESHELLCFG_OUTPUT_BUFFER
+#define ESHELLCFG_OUTPUT_BUFFER	128
+#endif
+
+#ifndef ESHELLCFG_OUTPUT_LINE_FLUSH
+#define ESHELLCFG_OUTPUT_LINE_FLUSH	0
+#endif
+
+/*
+ * Size of telnet session receive buffer.
+ */
+#ifndef ESHELLCFG_TELNET_RXBUF
+#define ESHELLCFG_TELNET_RXBUF	64
+#endif
+
 typedef enum {
 
   EshOK,
@@ -48,24 +78,105 @@ struct _eshContext;
 #define ESH_FLAG_CONSOLE	1
 #define ESH_FLAG_REMOTE		2
 
+typedef enum {
+
+  EshArgString,
+  EshArgInt,
+  EshArgBool,
+  EshArgIp4
+} EshArgType;
+
+#define ESH_ARG_NAMED		1
+#define ESH_ARG_REQUIRED	2
+#define ESH_ARG_LIST		4
+
+/*
+ * Argument schema entry. Command can list its arguments
+ * in a table terminated by entry with NULL name. eshParse
+ * then validates and converts arguments into ctx->values
+ * (using same index as in table) before calling handler.
+ * Positional arguments are matched in table order.
+ * If last positional argument is marked with ESH_ARG_LIST,
+ * any further positional arguments are left for handler
+ * to get with eshNextArg().
+ */
+typedef struct {
+
+  const char* name;
+  EshArgType  type;
+  int         flags;
+  int         min;
+  int         max;
+  int         def;
+  const char* help;
+
+} EshArgSpec;
+
+/*
+ * Converted argument value. str is always the
+ * original text, num holds integer and boolean values,
+ * ip4 holds address in host byte order.
+ */
+typedef struct {
+
+  bool     present;
+  char*    str;
+  int      num;
+  uint32_t ip4;
+
+} EshArgValue;
+
 typedef struct {
 
   const int   flags;
   const char* name;
   const char* help;
   int (*handler)(struct _eshContext* ctx);
+  const EshArgSpec* args;
   
 } EshCommand;
 
+extern const EshArgSpec eshNoArgs[];
+
+#if MAX_ARGS > 32
+#error MAX_ARGS must fit into argument bitmaps
+#endif
+
 typedef struct _eshContext {
 
   void  (*output)(struct _eshContext* ctx, const char*);
   bool  (*input)(struct _eshContext* ctx, char*, int);
+  void  (*poll)(struct _eshContext* ctx);
   int   argc;
   char* argv[MAX_ARGS];
+
+/*
+ * Argument index built by eshParse. Named arguments
+ * are argv[1] ... argv[named], positional ones follow them.
+ */
+  struct {
+
+    int      named;
+    int      next;
+    uint32_t used;
+    uint32_t dup;
+    uint8_t  nameLen[MAX_ARGS];
+
+  } args;
+
+  EshArgValue values[MAX_ARG_SPECS];
+
+  struct {
+
+    int  len;
+    char buf[ESHELLCFG_OUTPUT_BUFFER];
+
+  } out;
+
   EshStatus error;
   const EshCommand* command;
   bool remote;
+  bool cancelled;
 
   struct {
 
@@ -74,18 +185,51 @@ typedef struct _eshContext {
     int   crState;
     bool  sga;
     bool  echo;
+    int   rxPos;
+    int   rxLen;
+    int   rxScan;
+    int   scanState;
+    uint8_t rxBuf[ESHELLCFG_TELNET_RXBUF];
 
   } telnet;
 
 } EshContext;  
 
 void  eshPrintf(EshContext*ctx, const char* fmt, ...);
+void  eshFlush(EshContext* ctx);
+bool  eshCancelled(EshContext* ctx);
 char* eshNextArg(EshContext* ctx, bool must);
 char* eshNamedArg(EshContext* ctx, const char* name, bool must);
 EshStatus eshArgError(EshContext* ctx);
 void  eshCheckNamedArgsUsed(EshContext* ctx);
 void  eshCheckArgsUsed(EshContext* ctx);
+void  eshInitCommands(void);
 int   eshParse(EshContext* ctx, char* buf);
 bool  eshPrompt(EshContext*ctx, const char* prompt, char* buf, int max);
 void  eshConsole(void);
 void  eshStartTelnetd(void);
+uint32_t eshMicros(void);
+
+#if ESHELLCFG_PROF
+/*
+ * Profiler sample, called from timer interrupt
+ * with interrupted program counter.
+ */
+void  eshProfSample(const void* pc);
+
+#if ESHELLCFG_PROF_SYMBOLS
+/*
+ * Optional symbol table for prof, sorted by address
+ * and terminated by entry with NULL name.
+ * Application should define this.
+ */
+typedef struct {
+
+  uintptr_t   addr;
+  const char* name;
+
+} EshSymbol;
+
+extern const EshSymbol eshSymbolTable[];
+#endif
+#endif
@@ -49,12 +49,176 @@
 #include "lwip/netifapi.h"
 #include "eshell-commands.h"
 
+/*
+ * Max interfaces sampled by --rate.
+ */
+#define IFCONFIG_MAX_NETIFS 8
+
+enum {
+  IFCONFIG_ARG_STATS,
+  IFCONFIG_ARG_RATE
+};
+
+static const EshArgSpec ifconfigArgs[] = {
+
+  { .name = "stats", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "show link settings and counters" },
+  { .name = "rate", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 3600, .help = "show traffic over interval, seconds" },
+  { .name = NULL }
+};
+
+static const struct {
+
+  uint8_t     flag;
+  const char* name;
+
+} ifFlags[] = {
+
+  { NETIF_FLAG_UP, "up" },
+  { NETIF_FLAG_LINK_UP, "link" },
+  { NETIF_FLAG_BROADCAST, "broadcast" },
+  { NETIF_FLAG_ETHARP, "etharp" },
+  { NETIF_FLAG_ETHERNET, "ethernet" },
+  { NETIF_FLAG_IGMP, "igmp" }
+};
+
+#if MIB2_STATS
+
+typedef struct {
+
+  const struct netif* netif;
+  uint32_t inOctets;
+  uint32_t inPkts;
+  uint32_t outOctets;
+  uint32_t outPkts;
+
+} IfSample;
+
+static int ifSample(IfSample* samples)
+{
+  const struct netif* ifPtr;
+  int count = 0;
+
+  for (ifPtr = netif_list; ifPtr != NULL && count < IFCONFIG_MAX_NETIFS; ifPtr = ifPtr->next) {
+
+    samples[count].netif = ifPtr;
+    samples[count].inOctets = ifPtr->mib2_counters.ifinoctets;
+    samples[count].inPkts = ifPtr->mib2_counters.ifinucastpkts + ifPtr->mib2_counters.ifinnucastpkts;
+    samples[count].outOctets = ifPtr->mib2_counters.ifoutoctets;
+    samples[count].outPkts = ifPtr->mib2_counters.ifoutucastpkts + ifPtr->mib2_counters.ifoutnucastpkts;
+    count++;
+  }
+
+  return count;
+}
+
+/*
+ * Scale counter delta to per-second value.
+ */
+static uint32_t perSecond(uint32_t delta, uint32_t usecs)
+{
+  return (uint64_t)delta * 1000000 / usecs;
+}
+
+static int ifRate(EshContext* ctx, int seconds)
+{
+  IfSample before[IFCONFIG_MAX_NETIFS];
+  IfSample after[IFCONFIG_MAX_NETIFS];
+  int beforeCount;
+  int afterCount;
+  uint32_t start;
+  uint32_t elapsed;
+  int i;
+  int j;
+
+  beforeCount = ifSample(before);
+  start = eshMicros();
+
+/*
+ * Sleep in short steps, so that command
+ * can be interrupted.
+ */
+  for (i = 0; i < seconds * 10 && !eshCancelled(ctx); i++)
+    posTaskSleep(MS(100));
+
+  afterCount = ifSample(after);
+  elapsed = eshMicros() - start;
+  if (elapsed == 0)
+    elapsed = 1;
+
+  eshPrintf(ctx, "       %10s %12s %10s %12s\n", "rx pps", "rx bit/s", "tx pps", "tx bit/s");
+  for (j = 0; j < afterCount; j++) {
+
+    for (i = 0; i < beforeCount; i++)
+      if (before[i].netif == after[j].netif)
+        break;
+
+    if (i == beforeCount)
+      continue;
+
+    eshPrintf(ctx, "%.2s%d:   %10u %12u %10u %12u\n",
+              after[j].netif->name, after[j].netif->num,
+              (unsigned int)perSecond(after[j].inPkts - before[i].inPkts, elapsed),
+              (unsigned int)(perSecond(after[j].inOctets - before[i].inOctets, elapsed) * 8),
+              (unsigned int)perSecond(after[j].outPkts - before[i].outPkts, elapsed),
+              (unsigned int)(perSecond(after[j].outOctets - before[i].outOctets, elapsed) * 8));
+  }
+
+  return 0;
+}
+
+#endif
+
+static void ifStats(EshContext* ctx, const struct netif* ifPtr)
+{
+  int i;
+
+  const char* sep = "";
+
+  eshPrintf(ctx, "     mtu %u flags <", (unsigned int)ifPtr->mtu);
+  for (i = 0; i < (int)(sizeof(ifFlags) / sizeof(ifFlags[0])); i++) {
+
+    if (ifPtr->flags & ifFlags[i].flag) {
+
+      eshPrintf(ctx, "%s%s", sep, ifFlags[i].name);
+      sep = ",";
+    }
+  }
+
+  eshPrintf(ctx, ">");
+  if (ifPtr->hwaddr_len > 0) {
+
+    eshPrintf(ctx, " hwaddr ");
+    for (i = 0; i < ifPtr->hwaddr_len; i++)
+      eshPrintf(ctx, "%s%02x", i ? ":" : "", ifPtr->hwaddr[i]);
+  }
+
+  eshPrintf(ctx, "\n");
+
+#if MIB2_STATS
+  const struct stats_mib2_netif_ctrs* c = &ifPtr->mib2_counters;
+
+  eshPrintf(ctx, "     rx %u packets %u bytes %u errors %u dropped %u unknown proto\n",
+            (unsigned int)(c->ifinucastpkts + c->ifinnucastpkts), (unsigned int)c->ifinoctets,
+            (unsigned int)c->ifinerrors, (unsigned int)c->ifindiscards, (unsigned int)c->ifinunknownprotos);
+  eshPrintf(ctx, "     tx %u packets %u bytes %u errors %u dropped\n",
+            (unsigned int)(c->ifoutucastpkts + c->ifoutnucastpkts), (unsigned int)c->ifoutoctets,
+            (unsigned int)c->ifouterrors, (unsigned int)c->ifoutdiscards);
+#endif
+}
+
 static int ifconfig(EshContext * ctx)
 {
-  eshCheckNamedArgsUsed(ctx);
-  eshCheckArgsUsed(ctx);
-  if (eshArgError(ctx) != EshOK)
+  bool stats = ctx->values[IFCONFIG_ARG_STATS].num;
+
+  if (ctx->values[IFCONFIG_ARG_RATE].present) {
+
+#if MIB2_STATS
+    return ifRate(ctx, ctx->values[IFCONFIG_ARG_RATE].num);
+#else
+    eshPrintf(ctx, "ifconfig: --rate needs MIB2_STATS in lwipopts.h.\n");
     return -1;
+#endif
+  }
 
   const struct netif* ifPtr = netif_list;
   while (ifPtr) {
@@ -81,9 +245,17 @@ static int ifconfig(EshContext * ctx)
     }
 #endif
 
+    if (stats)
+      ifStats(ctx, ifPtr);
+
     ifPtr = ifPtr->next;
   }
 
+#if !MIB2_STATS
+  if (stats)
+    eshPrintf(ctx, "(counters need MIB2_STATS in lwipopts.h)\n");
+#endif
+
   return 0;
 }
 
@@ -91,7 +263,8 @@ const EshCommand eshIfconfigCommand = {
   .flags = 0,
   .name = "ifconfig",
   .help = "show interface settings",
-  .handler = ifconfig
+  .handler = ifconfig,
+  .args = ifconfigArgs
 };
 
 #endif
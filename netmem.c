@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <picoos.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+
+#if ESHELLCFG_LWIP
+
+#include <picoos-lwip.h>
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+#include "lwip/sys.h"
+#include "eshell-commands.h"
+
+enum {
+  NETMEM_ARG_RESET
+};
+
+static const EshArgSpec netmemArgs[] = {
+
+  { .name = "reset", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "clear high-water marks and error counts" },
+  { .name = NULL }
+};
+
+#if LWIP_STATS && MEMP_STATS
+
+/*
+ * Pool names straight from pool table, pool
+ * descriptors and stats carry them only in debug builds.
+ */
+static const char* const mempNames[] = {
+
+#define LWIP_MEMPOOL(name, num, size, desc) desc,
+#include "lwip/priv/memp_std.h"
+};
+
+typedef struct {
+
+  uint32_t used;
+  uint32_t avail;
+  uint32_t max;
+  uint32_t err;
+
+} NetmemSample;
+
+static void sample(NetmemSample* s, const struct stats_mem* mem)
+{
+  s->used = mem->used;
+  s->avail = mem->avail;
+  s->max = mem->max;
+  s->err = mem->err;
+}
+
+static void reset(struct stats_mem* mem)
+{
+  mem->max = mem->used;
+  mem->err = 0;
+}
+
+static void printSample(EshContext* ctx, const char* name, const NetmemSample* s)
+{
+  eshPrintf(ctx, "%-20s %7u %7u %7u %5u%s\n", name,
+            (unsigned int)s->used, (unsigned int)s->avail, (unsigned int)s->max, (unsigned int)s->err,
+            s->err ? " !" : (s->max == s->avail ? " full" : ""));
+}
+
+static int netmem(EshContext* ctx)
+{
+  NetmemSample pools[MEMP_MAX];
+#if MEM_STATS
+  NetmemSample heap;
+#endif
+  int i;
+
+  SYS_ARCH_DECL_PROTECT(lev);
+
+/*
+ * Copy counters while protected, so that
+ * they are consistent. Print them afterwards.
+ */
+  SYS_ARCH_PROTECT(lev);
+  for (i = 0; i < MEMP_MAX; i++) {
+
+    sample(&pools[i], lwip_stats.memp[i]);
+    if (ctx->values[NETMEM_ARG_RESET].num)
+      reset(lwip_stats.memp[i]);
+  }
+
+#if MEM_STATS
+  sample(&heap, &lwip_stats.mem);
+  if (ctx->values[NETMEM_ARG_RESET].num)
+    reset(&lwip_stats.mem);
+#endif
+
+  SYS_ARCH_UNPROTECT(lev);
+
+  eshPrintf(ctx, "%-20s %7s %7s %7s %5s\n", "pool", "used", "avail", "max", "err");
+  for (i = 0; i < MEMP_MAX; i++)
+    printSample(ctx, mempNames[i], &pools[i]);
+
+#if MEM_STATS
+  printSample(ctx, "HEAP", &heap);
+#endif
+
+  if (ctx->values[NETMEM_ARG_RESET].num)
+    eshPrintf(ctx, "high-water marks and errors cleared.\n");
+
+  return 0;
+}
+
+#else
+
+static int netmem(EshContext* ctx)
+{
+  eshPrintf(ctx, "netmem: needs LWIP_STATS and MEMP_STATS in lwipopts.h.\n");
+  return -1;
+}
+
+#endif
+
+const EshCommand eshNetmemCommand = {
+  .flags = 0,
+  .name = "netmem",
+  .help = "show lwip memory pool usage",
+  .handler = netmem,
+  .args = netmemArgs
+};
+
+#endif
@@ -0,0 +1,718 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <picoos.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+
+#if ESHELLCFG_LWIP
+
+#include <picoos-lwip.h>
+#include "eshell-commands.h"
+
+/*
+ * Largest buffer accepted by --len.
+ */
+#ifndef ESHELLCFG_NETPERF_MAX_LEN
+#define ESHELLCFG_NETPERF_MAX_LEN 4096
+#endif
+
+#define NETPERF_PORT     5001
+#define NETPERF_REPORTS  8
+
+/*
+ * Sockets use this timeout for both receive and
+ * send so that worker notices stop request and can
+ * report intervals when there is no traffic or
+ * peer doesn't read.
+ */
+#define NETPERF_POLL     200000
+
+/*
+ * UDP receiver ends the run if no datagrams arrive
+ * within this time, in case end marker was lost.
+ */
+#define NETPERF_UDP_IDLE 2000000
+
+/*
+ * Each UDP datagram starts with sequence number and
+ * sender timestamp. Last datagrams of a run have
+ * NETPERF_UDP_END set in sequence number.
+ */
+#define NETPERF_UDP_END  0x80000000
+
+enum {
+  NETPERF_ARG_SERVER,
+  NETPERF_ARG_UDP,
+  NETPERF_ARG_PORT,
+  NETPERF_ARG_TIME,
+  NETPERF_ARG_INTERVAL,
+  NETPERF_ARG_LEN,
+  NETPERF_ARG_RATE,
+  NETPERF_ARG_BACKGROUND,
+  NETPERF_ARG_STATUS,
+  NETPERF_ARG_STOP,
+  NETPERF_ARG_HOST
+};
+
+static const EshArgSpec netperfArgs[] = {
+
+  { .name = "server", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "start server task" },
+  { .name = "udp", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "use udp instead of tcp" },
+  { .name = "port", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 65535, .def = NETPERF_PORT, .help = "port number" },
+  { .name = "time", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 3600, .def = 10, .help = "test length, seconds" },
+  { .name = "interval", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 0, .max = 3600, .def = 1, .help = "seconds between reports, 0 for none" },
+  { .name = "len", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 16, .max = ESHELLCFG_NETPERF_MAX_LEN, .def = 1460, .help = "buffer or datagram size" },
+  { .name = "rate", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 1000000, .def = 1000, .help = "udp target rate, kbit/s" },
+  { .name = "background", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "don't wait for client to finish" },
+  { .name = "status", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "show tasks and pending reports" },
+  { .name = "stop", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "stop running tasks" },
+  { .name = "host", .type = EshArgString, .flags = 0, .help = "server to connect" },
+  { .name = NULL }
+};
+
+typedef struct __attribute__((packed)) {
+
+  uint32_t seq;
+  uint32_t sent;
+
+} NetperfUdpHdr;
+
+typedef struct {
+
+  uint32_t start;
+  uint32_t end;
+  uint64_t bytes;
+  uint32_t packets;
+  uint32_t lost;
+  uint32_t jitter;
+  bool     final;
+
+} NetperfReport;
+
+/*
+ * Counters of current run, private to worker task.
+ * Interval reports are differences to mark values.
+ */
+typedef struct {
+
+  uint32_t start;
+  uint32_t last;
+  uint64_t bytes;
+  uint32_t packets;
+  uint32_t lost;
+  uint32_t expect;
+  uint32_t jitter;
+  int32_t  transit;
+  uint32_t recvd;
+  uint64_t markBytes;
+  uint32_t markPackets;
+  uint32_t markLost;
+
+} NetperfRun;
+
+/*
+ * State of server or client task. Command fills settings
+ * before starting the task. Worker writes reports to ring
+ * and advances head, shell prints them and advances tail.
+ * Ring and its indices are accessed with scheduler locked,
+ * so that shell never sees partially written report.
+ */
+typedef struct {
+
+  volatile bool running;
+  volatile bool stop;
+  bool     server;
+  bool     udp;
+  int      len;
+  int      time;
+  int      interval;
+  uint32_t rate;
+  struct sockaddr_in addr;
+  volatile int error;
+  const char* volatile what;
+  NetperfReport reports[NETPERF_REPORTS];
+  uint32_t head;
+  uint32_t tail;
+
+} NetperfJob;
+
+static NetperfJob serverJob = { .server = true };
+static NetperfJob clientJob;
+
+static void setTimeout(int s, uint32_t usecs)
+{
+  struct timeval timeout;
+
+  timeout.tv_sec = usecs / 1000000;
+  timeout.tv_usec = usecs % 1000000;
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+static void jobError(NetperfJob* job, const char* what)
+{
+  job->what = what;
+  job->error = errno;
+}
+
+static void runStart(NetperfRun* run)
+{
+  memset(run, '\0', sizeof(NetperfRun));
+  run->start = eshMicros();
+  run->last = run->start;
+}
+
+static void runReport(NetperfJob* job, NetperfRun* run, bool final)
+{
+  NetperfReport r;
+  uint32_t now = eshMicros();
+
+  if (final) {
+
+    r.start = 0;
+    r.bytes = run->bytes;
+    r.packets = run->packets;
+    r.lost = run->lost;
+  }
+  else {
+
+    r.start = run->last - run->start;
+    r.bytes = run->bytes - run->markBytes;
+    r.packets = run->packets - run->markPackets;
+    r.lost = run->lost - run->markLost;
+  }
+
+  r.end = now - run->start;
+  r.jitter = run->jitter >> 4;
+  r.final = final;
+
+  run->last = now;
+  run->markBytes = run->bytes;
+  run->markPackets = run->packets;
+  run->markLost = run->lost;
+
+  posTaskSchedLock();
+  job->reports[job->head % NETPERF_REPORTS] = r;
+  job->head++;
+  posTaskSchedUnlock();
+}
+
+static void runTick(NetperfJob* job, NetperfRun* run)
+{
+  if (job->interval && eshMicros() - run->last >= (uint32_t)job->interval * 1000000)
+    runReport(job, run, false);
+}
+
+/*
+ * Update loss and jitter from UDP datagram header.
+ * Jitter is smoothed as in RFC 3550, kept scaled by 16.
+ */
+static void runUdp(NetperfRun* run, const NetperfUdpHdr* hdr)
+{
+  uint32_t seq = ntohl(hdr->seq);
+  int32_t transit = eshMicros() - ntohl(hdr->sent);
+  int32_t d;
+
+  if (seq >= run->expect) {
+
+    run->lost += seq - run->expect;
+    run->expect = seq + 1;
+  }
+  else if (run->lost > 0)
+    run->lost--;
+
+  if (run->recvd++ > 0) {
+
+    d = transit - run->transit;
+    if (d < 0)
+      d = -d;
+
+    run->jitter += d - ((run->jitter + 8) >> 4);
+  }
+
+  run->transit = transit;
+}
+
+static void serverUdp(NetperfJob* job, int s, char* buf)
+{
+  NetperfRun run;
+  bool active = false;
+  uint32_t lastRecv = 0;
+  int len;
+
+  while (!job->stop) {
+
+    len = recv(s, buf, job->len, 0);
+    if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+
+      jobError(job, "recv");
+      break;
+    }
+
+    if (len >= (int)sizeof(NetperfUdpHdr)) {
+
+      NetperfUdpHdr* hdr = (NetperfUdpHdr*)buf;
+
+      if (ntohl(hdr->seq) & NETPERF_UDP_END) {
+
+        if (active)
+          runReport(job, &run, true);
+
+        active = false;
+        continue;
+      }
+
+      if (!active) {
+
+        runStart(&run);
+        active = true;
+      }
+
+      run.bytes += len;
+      run.packets++;
+      runUdp(&run, hdr);
+      lastRecv = eshMicros();
+    }
+
+    if (active) {
+
+      if (len <= 0 && eshMicros() - lastRecv >= NETPERF_UDP_IDLE) {
+
+        runReport(job, &run, true);
+        active = false;
+        continue;
+      }
+
+      runTick(job, &run);
+    }
+  }
+
+  if (active)
+    runReport(job, &run, true);
+}
+
+static void serverTcp(NetperfJob* job, int s, char* buf)
+{
+  NetperfRun run;
+  struct sockaddr_in peer;
+  socklen_t peerLen;
+  int conn;
+  int len;
+
+  listen(s, 1);
+  while (!job->stop) {
+
+    peerLen = sizeof(peer);
+    conn = accept(s, (struct sockaddr*)&peer, &peerLen);
+    if (conn == -1)
+      continue;
+
+    setTimeout(conn, NETPERF_POLL);
+    runStart(&run);
+    while (!job->stop) {
+
+      len = recv(conn, buf, job->len, 0);
+      if (len == 0)
+        break;
+
+      if (len < 0) {
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+
+          jobError(job, "recv");
+          break;
+        }
+      }
+      else
+        run.bytes += len;
+
+      runTick(job, &run);
+    }
+
+    runReport(job, &run, true);
+    closesocket(conn);
+  }
+}
+
+static void clientTcp(NetperfJob* job, int s, char* buf)
+{
+  NetperfRun run;
+  int len;
+
+  if (connect(s, (struct sockaddr*)&job->addr, sizeof(job->addr)) == -1) {
+
+    jobError(job, "connect");
+    return;
+  }
+
+  runStart(&run);
+  while (!job->stop && eshMicros() - run.start < (uint32_t)job->time * 1000000) {
+
+    len = send(s, buf, job->len, 0);
+    if (len < 0) {
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+
+        jobError(job, "send");
+        break;
+      }
+    }
+    else
+      run.bytes += len;
+
+    runTick(job, &run);
+  }
+
+  runReport(job, &run, true);
+}
+
+/*
+ * Send datagrams paced to target rate. When ahead of
+ * schedule by at least one tick, sleep. Otherwise
+ * send until schedule is met.
+ */
+static void clientUdp(NetperfJob* job, int s, char* buf)
+{
+  NetperfRun run;
+  NetperfUdpHdr* hdr = (NetperfUdpHdr*)buf;
+  uint32_t gap = (uint64_t)job->len * 8 * 1000 / job->rate;
+  uint32_t next;
+  uint32_t now;
+  int ticks;
+  int i;
+
+  runStart(&run);
+  next = run.start;
+  while (!job->stop && eshMicros() - run.start < (uint32_t)job->time * 1000000) {
+
+    now = eshMicros();
+    if ((int32_t)(next - now) > 0) {
+
+      ticks = MS((next - now) / 1000);
+      posTaskSleep(ticks > 0 ? ticks : 1);
+      runTick(job, &run);
+      continue;
+    }
+
+    hdr->seq = htonl(run.packets);
+    hdr->sent = htonl(now);
+    if (sendto(s, buf, job->len, 0, (struct sockaddr*)&job->addr, sizeof(job->addr)) < 0) {
+
+      jobError(job, "send");
+      break;
+    }
+
+    run.bytes += job->len;
+    run.packets++;
+    next += gap;
+    runTick(job, &run);
+  }
+
+  hdr->seq = htonl(NETPERF_UDP_END | run.packets);
+  for (i = 0; i < 3; i++)
+    sendto(s, buf, sizeof(NetperfUdpHdr), 0, (struct sockaddr*)&job->addr, sizeof(job->addr));
+
+  runReport(job, &run, true);
+}
+
+static void netperfTask(void* arg)
+{
+  NetperfJob* job = (NetperfJob*)arg;
+  char* buf;
+  int s;
+
+  buf = nosMemAlloc(job->len);
+  if (buf == NULL) {
+
+    jobError(job, "alloc");
+    job->running = false;
+    return;
+  }
+
+  memset(buf, '\0', job->len);
+  s = socket(AF_INET, job->udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+  if (s == -1) {
+
+    jobError(job, "socket");
+    nosMemFree(buf);
+    job->running = false;
+    return;
+  }
+
+  setTimeout(s, NETPERF_POLL);
+  if (job->server) {
+
+    if (bind(s, (struct sockaddr*)&job->addr, sizeof(job->addr)) == -1)
+      jobError(job, "bind");
+    else if (job->udp)
+      serverUdp(job, s, buf);
+    else
+      serverTcp(job, s, buf);
+  }
+  else if (job->udp)
+    clientUdp(job, s, buf);
+  else
+    clientTcp(job, s, buf);
+
+  closesocket(s);
+  nosMemFree(buf);
+  job->running = false;
+}
+
+/*
+ * Print bytes / usecs as Mbit/s with two decimals.
+ */
+static void printRate(EshContext* ctx, uint64_t bytes, uint32_t usecs)
+{
+  uint32_t kbit = usecs ? bytes * 8000 / usecs : 0;
+
+  eshPrintf(ctx, "%5u.%02u Mbit/s", (unsigned int)(kbit / 1000), (unsigned int)(kbit % 1000 / 10));
+}
+
+static void printReport(EshContext* ctx, const NetperfJob* job, const NetperfReport* r)
+{
+  eshPrintf(ctx, "%s %4u.%u-%4u.%u s %9u KB ",
+            r->final ? "total" : "     ",
+            (unsigned int)(r->start / 1000000), (unsigned int)(r->start / 100000 % 10),
+            (unsigned int)(r->end / 1000000), (unsigned int)(r->end / 100000 % 10),
+            (unsigned int)(r->bytes / 1024));
+
+  printRate(ctx, r->bytes, r->end - r->start);
+  if (job->udp) {
+
+    eshPrintf(ctx, " %6u packets", (unsigned int)r->packets);
+    if (job->server)
+      eshPrintf(ctx, ", %u lost (%u%%), jitter %u.%03u ms",
+                (unsigned int)r->lost,
+                (unsigned int)(r->packets + r->lost ? 100 * r->lost / (r->packets + r->lost) : 0),
+                (unsigned int)(r->jitter / 1000), (unsigned int)(r->jitter % 1000));
+  }
+
+  eshPrintf(ctx, "\n");
+}
+
+/*
+ * Print reports not yet shown. If shell has fallen
+ * behind by more than ring size, oldest ones are lost.
+ */
+static void printReports(EshContext* ctx, NetperfJob* job)
+{
+  NetperfReport r;
+
+  for(;;) {
+
+    posTaskSchedLock();
+    if (job->head - job->tail > NETPERF_REPORTS)
+      job->tail = job->head - NETPERF_REPORTS;
+
+    if (job->tail == job->head) {
+
+      posTaskSchedUnlock();
+      break;
+    }
+
+    r = job->reports[job->tail % NETPERF_REPORTS];
+    job->tail++;
+    posTaskSchedUnlock();
+
+    printReport(ctx, job, &r);
+  }
+
+  if (job->error && !job->running) {
+
+    eshPrintf(ctx, "netperf: %s: %s failed, error %d.\n", job->server ? "server" : "client", job->what, job->error);
+    job->error = 0;
+  }
+}
+
+static void printStatus(EshContext* ctx, NetperfJob* job)
+{
+  eshPrintf(ctx, "%s: ", job->server ? "server" : "client");
+  if (job->running)
+    eshPrintf(ctx, "running, %s %s %s:%u\n", job->udp ? "udp" : "tcp", job->server ? "on" : "to",
+              inet_ntoa(job->addr.sin_addr), (unsigned int)ntohs(job->addr.sin_port));
+  else
+    eshPrintf(ctx, "idle\n");
+
+  printReports(ctx, job);
+}
+
+static bool jobStart(EshContext* ctx, NetperfJob* job)
+{
+  bool busy;
+
+  posTaskSchedLock();
+  busy = job->running;
+  job->running = true;
+  posTaskSchedUnlock();
+
+  if (busy) {
+
+    eshPrintf(ctx, "netperf: %s already running.\n", job->server ? "server" : "client");
+    return false;
+  }
+
+  job->stop = false;
+  job->error = 0;
+  job->head = 0;
+  job->tail = 0;
+  job->udp = ctx->values[NETPERF_ARG_UDP].num;
+  job->len = ctx->values[NETPERF_ARG_LEN].num;
+  job->time = ctx->values[NETPERF_ARG_TIME].num;
+  job->interval = ctx->values[NETPERF_ARG_INTERVAL].num;
+  job->rate = ctx->values[NETPERF_ARG_RATE].num;
+  job->addr.sin_port = htons(ctx->values[NETPERF_ARG_PORT].num);
+
+/*
+ * UDP server must not truncate datagrams,
+ * otherwise byte counts are wrong.
+ */
+  if (job->server && job->udp && !ctx->values[NETPERF_ARG_LEN].present)
+    job->len = ESHELLCFG_NETPERF_MAX_LEN;
+
+  if (job->udp && job->len < (int)sizeof(NetperfUdpHdr))
+    job->len = sizeof(NetperfUdpHdr);
+
+  if (nosTaskCreate(netperfTask, (void*)job, 2, 1500, job->server ? "netperfs" : "netperfc") == NULL) {
+
+    eshPrintf(ctx, "netperf: failed to create task.\n");
+    job->running = false;
+    return false;
+  }
+
+  return true;
+}
+
+static bool resolveHost(EshContext* ctx, const char* host, struct sockaddr_in* addr)
+{
+  struct addrinfo hints;
+  struct addrinfo* res;
+
+  memset(&hints, '\0', sizeof(hints));
+  hints.ai_family = AF_INET;
+
+  if (getaddrinfo(host, NULL, &hints, &res)) {
+
+    eshPrintf(ctx, "netperf: unknown host %s\n", host);
+    return false;
+  }
+
+  memcpy(addr, res->ai_addr, sizeof(struct sockaddr_in));
+  freeaddrinfo(res);
+  return true;
+}
+
+static int netperf(EshContext* ctx)
+{
+  char* host = ctx->values[NETPERF_ARG_HOST].str;
+
+  if (ctx->values[NETPERF_ARG_STOP].num) {
+
+    serverJob.stop = true;
+    clientJob.stop = true;
+    return 0;
+  }
+
+  if (ctx->values[NETPERF_ARG_STATUS].num) {
+
+    printStatus(ctx, &serverJob);
+    printStatus(ctx, &clientJob);
+    return 0;
+  }
+
+  if (ctx->values[NETPERF_ARG_SERVER].num) {
+
+    if (serverJob.running) {
+
+      eshPrintf(ctx, "netperf: server already running.\n");
+      return -1;
+    }
+
+    memset(&serverJob.addr, '\0', sizeof(serverJob.addr));
+    serverJob.addr.sin_family = AF_INET;
+    serverJob.addr.sin_addr.s_addr = INADDR_ANY;
+    return jobStart(ctx, &serverJob) ? 0 : -1;
+  }
+
+  if (host == NULL) {
+
+    eshPrintf(ctx, "netperf: host needed for client.\n");
+    return -1;
+  }
+
+  if (clientJob.running) {
+
+    eshPrintf(ctx, "netperf: client already running.\n");
+    return -1;
+  }
+
+  if (!resolveHost(ctx, host, &clientJob.addr))
+    return -1;
+
+  if (!jobStart(ctx, &clientJob))
+    return -1;
+
+  if (ctx->values[NETPERF_ARG_BACKGROUND].num)
+    return 0;
+
+/*
+ * Wait for client task, printing interval reports.
+ * Interrupt stops the test and prints totals.
+ */
+  while (clientJob.running) {
+
+    if (eshCancelled(ctx))
+      clientJob.stop = true;
+
+    printReports(ctx, &clientJob);
+    eshFlush(ctx);
+    posTaskSleep(MS(100));
+  }
+
+  printReports(ctx, &clientJob);
+  return 0;
+}
+
+const EshCommand eshNetperfCommand = {
+  .flags = 0,
+  .name = "netperf",
+  .help = "tcp/udp throughput test",
+  .handler = netperf,
+  .args = netperfArgs
+};
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <picoos.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+
+#if ESHELLCFG_LWIP
+
+#include <picoos-lwip.h>
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "eshell-commands.h"
+
+/*
+ * Max number of PCBs copied for one listing.
+ */
+#ifndef ESHELLCFG_NETSTAT_MAX
+#define ESHELLCFG_NETSTAT_MAX 32
+#endif
+
+/*
+ * PCB lists may only be walked while tcpip thread
+ * is kept out. Without core locking, block it
+ * with lwIP protection instead.
+ */
+#if LWIP_TCPIP_CORE_LOCKING
+#define NETSTAT_DECL_LOCK()
+#define NETSTAT_LOCK()      LOCK_TCPIP_CORE()
+#define NETSTAT_UNLOCK()    UNLOCK_TCPIP_CORE()
+#else
+#define NETSTAT_DECL_LOCK() SYS_ARCH_DECL_PROTECT(lev)
+#define NETSTAT_LOCK()      SYS_ARCH_PROTECT(lev)
+#define NETSTAT_UNLOCK()    SYS_ARCH_UNPROTECT(lev)
+#endif
+
+typedef struct {
+
+  bool      udp;
+  uint8_t   state;
+  ip_addr_t localIp;
+  ip_addr_t remoteIp;
+  uint16_t  localPort;
+  uint16_t  remotePort;
+  uint32_t  sndWnd;
+  uint32_t  rcvWnd;
+  uint16_t  queueLen;
+  uint16_t  unacked;
+  uint16_t  unsent;
+  uint8_t   nrtx;
+  uint8_t   dupacks;
+
+} NetstatEntry;
+
+static const char* const tcpStates[] = {
+
+  "CLOSED",
+  "LISTEN",
+  "SYN_SENT",
+  "SYN_RCVD",
+  "ESTABLISHED",
+  "FIN_WAIT_1",
+  "FIN_WAIT_2",
+  "CLOSE_WAIT",
+  "CLOSING",
+  "LAST_ACK",
+  "TIME_WAIT"
+};
+
+#if LWIP_TCP
+
+static int countSegs(const struct tcp_seg* seg)
+{
+  int count = 0;
+
+  for (; seg != NULL; seg = seg->next)
+    count++;
+
+  return count;
+}
+
+static void tcpEntry(NetstatEntry* e, const struct tcp_pcb* pcb)
+{
+  memset(e, '\0', sizeof(NetstatEntry));
+  e->state = pcb->state;
+  ip_addr_copy(e->localIp, pcb->local_ip);
+  ip_addr_copy(e->remoteIp, pcb->remote_ip);
+  e->localPort = pcb->local_port;
+  e->remotePort = pcb->remote_port;
+  e->sndWnd = pcb->snd_wnd;
+  e->rcvWnd = pcb->rcv_wnd;
+  e->queueLen = pcb->snd_queuelen;
+  e->unacked = countSegs(pcb->unacked);
+  e->unsent = countSegs(pcb->unsent);
+  e->nrtx = pcb->nrtx;
+  e->dupacks = pcb->dupacks;
+}
+
+#endif
+
+/*
+ * Copy PCB state while lwIP core is locked.
+ * Returns total number of PCBs, which may be
+ * more than fits into table.
+ */
+static int snapshot(NetstatEntry* table, int max)
+{
+  int count = 0;
+
+  NETSTAT_DECL_LOCK();
+  NETSTAT_LOCK();
+
+#if LWIP_TCP
+  const struct tcp_pcb_listen* lpcb;
+  const struct tcp_pcb* pcb;
+
+  for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next, count++) {
+
+    if (count < max) {
+
+      memset(&table[count], '\0', sizeof(NetstatEntry));
+      table[count].state = LISTEN;
+      ip_addr_copy(table[count].localIp, lpcb->local_ip);
+      table[count].localPort = lpcb->local_port;
+    }
+  }
+
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next, count++)
+    if (count < max)
+      tcpEntry(&table[count], pcb);
+
+  for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next, count++)
+    if (count < max)
+      tcpEntry(&table[count], pcb);
+#endif
+
+#if LWIP_UDP
+  const struct udp_pcb* upcb;
+
+  for (upcb = udp_pcbs; upcb != NULL; upcb = upcb->next, count++) {
+
+    if (count < max) {
+
+      memset(&table[count], '\0', sizeof(NetstatEntry));
+      table[count].udp = true;
+      ip_addr_copy(table[count].localIp, upcb->local_ip);
+      ip_addr_copy(table[count].remoteIp, upcb->remote_ip);
+      table[count].localPort = upcb->local_port;
+      table[count].remotePort = upcb->remote_port;
+    }
+  }
+#endif
+
+  NETSTAT_UNLOCK();
+  return count;
+}
+
+static void printEndpoint(EshContext* ctx, const ip_addr_t* ip, uint16_t port)
+{
+  char buf[IPADDR_STRLEN_MAX + 8];
+  int len;
+
+  if (ip_addr_isany(ip))
+    strcpy(buf, "*");
+  else
+    ipaddr_ntoa_r(ip, buf, IPADDR_STRLEN_MAX);
+
+  len = strlen(buf);
+  if (port)
+    sprintf(buf + len, ":%u", (unsigned int)port);
+  else
+    strcpy(buf + len, ":*");
+
+  eshPrintf(ctx, " %-21s", buf);
+}
+
+static int netstat(EshContext* ctx)
+{
+  NetstatEntry* table;
+  NetstatEntry* e;
+  const char* state;
+  int count;
+  int i;
+
+  table = nosMemAlloc(ESHELLCFG_NETSTAT_MAX * sizeof(NetstatEntry));
+  if (table == NULL) {
+
+    eshPrintf(ctx, "netstat: out of memory.\n");
+    return -1;
+  }
+
+  count = snapshot(table, ESHELLCFG_NETSTAT_MAX);
+
+  eshPrintf(ctx, "proto %-21s %-21s %-11s %7s %7s %5s %5s %6s %3s %3s\n",
+            "local", "remote", "state", "snd_wnd", "rcv_wnd", "queue", "unack", "unsent", "rtx", "dup");
+
+  for (i = 0; i < count && i < ESHELLCFG_NETSTAT_MAX; i++) {
+
+    e = &table[i];
+    eshPrintf(ctx, "%-5s", e->udp ? "udp" : "tcp");
+    printEndpoint(ctx, &e->localIp, e->localPort);
+    printEndpoint(ctx, &e->remoteIp, e->remotePort);
+
+    if (e->udp) {
+
+      eshPrintf(ctx, "\n");
+      continue;
+    }
+
+    state = e->state < sizeof(tcpStates) / sizeof(tcpStates[0]) ? tcpStates[e->state] : "?";
+    if (e->state == LISTEN)
+      eshPrintf(ctx, " %s\n", state);
+    else
+      eshPrintf(ctx, " %-11s %7u %7u %5u %5u %6u %3u %3u\n", state,
+                (unsigned int)e->sndWnd, (unsigned int)e->rcvWnd, (unsigned int)e->queueLen,
+                (unsigned int)e->unacked, (unsigned int)e->unsent,
+                (unsigned int)e->nrtx, (unsigned int)e->dupacks);
+  }
+
+  if (count > ESHELLCFG_NETSTAT_MAX)
+    eshPrintf(ctx, "(%d more not shown)\n", count - ESHELLCFG_NETSTAT_MAX);
+
+  nosMemFree(table);
+  return 0;
+}
+
+const EshCommand eshNetstatCommand = {
+  .flags = 0,
+  .name = "netstat",
+  .help = "list tcp and udp connections",
+  .handler = netstat,
+  .args = eshNoArgs
+};
+
+#endif
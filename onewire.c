@@ -41,11 +41,6 @@
 
 static int onewire(EshContext * ctx)
 {
-  eshCheckNamedArgsUsed(ctx);
-  eshCheckArgsUsed(ctx);
-  if (eshArgError(ctx) != EshOK)
-    return -1;
-
   int   rslt;
   uint8_t serialNum[8];
   float value;
@@ -59,7 +54,7 @@ static int onewire(EshContext * ctx)
 
   rslt = owFirst(0, TRUE, FALSE);
 
-  while (rslt) {
+  while (rslt && !eshCancelled(ctx)) {
 
     owSerialNum(0, serialNum, TRUE);
 
@@ -72,6 +67,7 @@ static int onewire(EshContext * ctx)
 
     ReadTemperature(0, serialNum, &value);
     eshPrintf(ctx, "=%1.1f\n", value);
+    eshFlush(ctx);
     rslt = owNext(0, TRUE, FALSE);
   }
 
@@ -83,7 +79,8 @@ const EshCommand eshOnewireCommand = {
   .flags = 0,
   .name = "onewire",
   .help = "list onewire bus",
-  .handler = onewire
+  .handler = onewire,
+  .args = eshNoArgs
 };
 
 #endif
@@ -52,128 +52,858 @@
 #include <lwip/inet_chksum.h>
 #include <lwip/ip4.h>
 #include "eshell-commands.h"
+#include "eshell-ping.h"
 
-#define PING_DATA_SIZE 50
+/*
+ * Largest payload accepted by --size.
+ */
+#ifndef ESHELLCFG_PING_MAX_SIZE
+#define ESHELLCFG_PING_MAX_SIZE 512
+#endif
+
+/*
+ * Sweep settings. By default each host gets SWEEP_ROUNDS
+ * echo requests, SWEEP_INTERVAL apart. Both can be
+ * overridden with --count and --interval.
+ */
+#ifndef ESHELLCFG_PING_SWEEP_MAX
+#define ESHELLCFG_PING_SWEEP_MAX 64
+#endif
+
+#define SWEEP_ROUNDS     3
+#define SWEEP_MAX_ROUNDS 8
+#define SWEEP_INTERVAL   100000
+
+#define HIST_BUCKETS     13
+
+/*
+ * Number of recent requests remembered for
+ * matching late replies.
+ */
+#define PING_HISTORY     16
+
+/*
+ * Flood mode defaults.
+ */
+#define FLOOD_COUNT      1000
+#define FLOOD_MAX_WINDOW 256
+
+enum {
+  PING_ARG_SWEEP,
+  PING_ARG_FLOOD,
+  PING_ARG_WINDOW,
+  PING_ARG_COUNT,
+  PING_ARG_INTERVAL,
+  PING_ARG_SIZE,
+  PING_ARG_TIMEOUT,
+  PING_ARG_HOST
+};
+
+static const EshArgSpec pingArgs[] = {
+
+  { .name = "sweep", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "ping hosts or a.b.c.d/n in parallel" },
+  { .name = "flood", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "send as fast as replies arrive" },
+  { .name = "window", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = FLOOD_MAX_WINDOW, .def = 16, .help = "requests in flight in flood mode" },
+  { .name = "count", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 65535, .def = 10, .help = "requests to send" },
+  { .name = "interval", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 60000, .def = 500, .help = "ms between requests" },
+  { .name = "size", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 0, .max = ESHELLCFG_PING_MAX_SIZE, .def = 50, .help = "payload bytes" },
+  { .name = "timeout", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 60000, .def = 1000, .help = "reply timeout ms" },
+  { .name = "host", .type = EshArgString, .flags = ESH_ARG_REQUIRED | ESH_ARG_LIST, .help = "host name or address" },
+  { .name = NULL }
+};
+
+/*
+ * Round-trip time statistics, in microseconds.
+ * Replies that arrive after their timeout are counted
+ * as late, but their round-trip time is included.
+ */
+typedef struct {
+
+  int      sent;
+  int      received;
+  int      late;
+  int      samples;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint64_t sum2;
+  int      hist[HIST_BUCKETS];
+
+} PingStats;
+
+typedef struct {
+
+  uint32_t sent;
+  uint16_t seq;
+  bool     busy;
+
+} PingSlot;
+
+typedef struct {
+
+  struct in_addr addr;
+  PingStats stats;
+  uint32_t  sent[SWEEP_MAX_ROUNDS];
+  uint8_t   replied;
+
+} SweepTarget;
+
+/*
+ * Upper limits of histogram buckets, last
+ * one collects everything slower.
+ */
+static const uint32_t histLimits[HIST_BUCKETS - 1] = {
 
-typedef struct __attribute__((packed)) {
+  100, 200, 500, 1000, 2000, 5000, 10000,
+  20000, 50000, 100000, 200000, 500000
+};
+
+/*
+ * Each ping invocation uses its own id, so
+ * concurrent pings don't get each other's replies.
+ */
+static uint16_t pingId = 0x1942;
 
-  struct icmp_echo_hdr hdr;
-  char data[PING_DATA_SIZE];
-} PingPacket;
+uint16_t pingNextId(void)
+{
+  return pingId++;
+}
 
-static int pingSend(int s, struct sockaddr *to, int toLen, int seq)
+PingPacket* pingAlloc(EshContext* ctx, uint16_t id, int size)
 {
-  size_t i;
-  PingPacket packet;
+  PingPacket* packet;
+  int i;
 
-  packet.hdr.type = ICMP_ECHO;
-  packet.hdr.code = 0;
-  packet.hdr.chksum = 0;
-  packet.hdr.id = 0x1942;
-  packet.hdr.seqno = htons(seq);
+  packet = nosMemAlloc(sizeof(PingPacket) + size);
+  if (packet == NULL) {
 
-  for (i = 0; i < PING_DATA_SIZE; i++)
-  packet.data[i] = (char)i;
+    eshPrintf(ctx, "%s: out of memory.\n", ctx->argv[0]);
+    return NULL;
+  }
 
-  packet.hdr.chksum = inet_chksum(&packet, sizeof(packet));
+  packet->hdr.type = ICMP_ECHO;
+  packet->hdr.code = 0;
+  packet->hdr.id = id;
+  packet->hdr.seqno = 0;
+  packet->hdr.chksum = 0;
 
-  return sendto(s, &packet, sizeof(packet), 0, to, toLen);
+  for (i = 0; i < size; i++)
+    packet->data[i] = (char)i;
+
+  packet->hdr.chksum = inet_chksum(packet, sizeof(PingPacket) + size);
+  return packet;
+}
+
+/*
+ * Packet is built only once. When sequence number
+ * changes, checksum is updated incrementally (RFC 1624)
+ * instead of summing whole packet again.
+ */
+int pingSend(int s, const struct sockaddr *to, int toLen, PingPacket* packet, int size, int seq)
+{
+  uint16_t seqno = htons(seq);
+  uint32_t sum;
+
+  sum = (uint16_t)~packet->hdr.chksum + (uint16_t)~packet->hdr.seqno + seqno;
+  sum = (sum & 0xFFFF) + (sum >> 16);
+  sum = (sum & 0xFFFF) + (sum >> 16);
+
+  packet->hdr.chksum = ~sum;
+  packet->hdr.seqno = seqno;
+
+  return sendto(s, packet, sizeof(PingPacket) + size, 0, to, toLen);
 }
 
-static bool pingReceive(int s, struct sockaddr *to, int toLen, int seq)
+/*
+ * Receive next echo reply. Returns false if there is
+ * no reply before deadline. Socket timeout is shortened
+ * before each receive, so that other ICMP traffic
+ * doesn't extend the wait. Only headers are needed,
+ * so payload is truncated.
+ */
+static bool pingReceiveAny(int s, uint32_t deadline, struct in_addr* from, uint16_t* id, uint16_t* seq)
 {
   int len;
-  char buf[sizeof(struct ip_hdr) + sizeof(PingPacket)];
+  char buf[60 + sizeof(PingPacket)];
   PingPacket *packet;
 
-  struct sockaddr_in from;
+  struct sockaddr_in fromAddr;
   int fromlen;
   struct ip_hdr *iphdr;
+  uint32_t now;
 
-  fromlen = sizeof(struct sockaddr_in);
+  while (true) {
 
-  while ((len = recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr *)&from, (socklen_t *) &fromlen)) > 0) {
+    now = eshMicros();
+    if ((int32_t)(deadline - now) <= 0)
+      return false;
 
-    if (len >= (int)(sizeof(struct ip_hdr) + sizeof(struct icmp_echo_hdr))) {
+    pingSetTimeout(s, deadline - now);
+    fromlen = sizeof(struct sockaddr_in);
+    len = recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr *)&fromAddr, (socklen_t *) &fromlen);
+    if (len <= 0)
+      return false;
 
-      if (from.sin_family == AF_INET && from.sin_addr.s_addr == ((struct sockaddr_in*)(void*)to)->sin_addr.s_addr) {
+    if (len >= (int)(sizeof(struct ip_hdr) + sizeof(struct icmp_echo_hdr)) && fromAddr.sin_family == AF_INET) {
 
-        iphdr = (struct ip_hdr *)buf;
-        packet = (PingPacket*)(buf + (IPH_HL(iphdr) * 4));
-        if ((packet->hdr.id == 0x1942) && (packet->hdr.seqno == htons(seq))) {
+      iphdr = (struct ip_hdr *)buf;
+      packet = (PingPacket*)(buf + (IPH_HL(iphdr) * 4));
+      if (len >= IPH_HL(iphdr) * 4 + (int)sizeof(struct icmp_echo_hdr) && packet->hdr.type == ICMP_ER) {
 
-          return true;
-        }
+        *from = fromAddr.sin_addr;
+        *id = packet->hdr.id;
+        *seq = ntohs(packet->hdr.seqno);
+        return true;
       }
     }
+  }
+}
 
-    fromlen = sizeof(struct sockaddr_in);
+void pingSetTimeout(int s, uint32_t usecs)
+{
+  struct timeval timeout;
+
+  if (usecs < 1000)
+    usecs = 1000;
+
+  timeout.tv_sec = usecs / 1000000;
+  timeout.tv_usec = usecs % 1000000;
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+static void statsRtt(PingStats* stats, uint32_t rtt)
+{
+  int i;
+
+  if (stats->samples == 0 || rtt < stats->min)
+    stats->min = rtt;
+
+  if (rtt > stats->max)
+    stats->max = rtt;
+
+  stats->sum += rtt;
+  stats->sum2 += (uint64_t)rtt * rtt;
+  stats->samples++;
+
+  for (i = 0; i < HIST_BUCKETS - 1; i++)
+    if (rtt < histLimits[i])
+      break;
+
+  stats->hist[i]++;
+}
+
+static void statsAdd(PingStats* stats, uint32_t rtt)
+{
+  stats->received++;
+  statsRtt(stats, rtt);
+}
+
+static void statsAddLate(PingStats* stats, uint32_t rtt)
+{
+  stats->late++;
+  statsRtt(stats, rtt);
+}
+
+static uint32_t isqrt(uint64_t x)
+{
+  uint64_t r = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+
+  while (bit > x)
+    bit >>= 2;
+
+  while (bit != 0) {
+
+    if (x >= r + bit) {
+
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    }
+    else
+      r >>= 1;
+
+    bit >>= 2;
+  }
+
+  return r;
+}
+
+static uint32_t statsAvg(const PingStats* stats)
+{
+  return stats->sum / stats->samples;
+}
+
+static uint32_t statsMdev(const PingStats* stats)
+{
+  uint64_t avg = stats->sum / stats->samples;
+  uint64_t avg2 = stats->sum2 / stats->samples;
+
+  return avg2 > avg * avg ? isqrt(avg2 - avg * avg) : 0;
+}
+
+/*
+ * Wait for reply to request seq until deadline.
+ * Replies to earlier requests that are still remembered
+ * in history are recorded as late.
+ */
+static bool pingReceive(int s, const struct sockaddr *to, uint16_t id, int seq,
+                        uint32_t deadline, PingSlot* history, PingStats* stats)
+{
+  struct in_addr from;
+  uint16_t replyId;
+  uint16_t replySeq;
+  PingSlot* slot;
+
+  while (pingReceiveAny(s, deadline, &from, &replyId, &replySeq)) {
+
+    if (from.s_addr != ((const struct sockaddr_in*)(const void*)to)->sin_addr.s_addr || replyId != id)
+      continue;
+
+    slot = &history[replySeq % PING_HISTORY];
+    if (!slot->busy || slot->seq != replySeq)
+      continue;
+
+    slot->busy = false;
+    if (replySeq == (uint16_t)seq) {
+
+      statsAdd(stats, eshMicros() - slot->sent);
+      return true;
+    }
+
+    statsAddLate(stats, eshMicros() - slot->sent);
   }
 
   return false;
 }
 
-static int ping(EshContext * ctx)
+/*
+ * Print microsecond value as milliseconds.
+ */
+void pingPrintMs(EshContext* ctx, const char* sep, uint32_t usecs)
 {
-  eshCheckNamedArgsUsed(ctx);
-  char *host = eshNextArg(ctx, true);
+  eshPrintf(ctx, "%s%u.%03u", sep, (unsigned int)(usecs / 1000), (unsigned int)(usecs % 1000));
+}
 
-  eshCheckArgsUsed(ctx);
-  if (eshArgError(ctx) != EshOK)
-    return -1;
+static void statsPrint(EshContext* ctx, const PingStats* stats)
+{
+  int i;
+  int max = 0;
+  int bar;
+
+  eshPrintf(ctx, "%d sent, %d received", stats->sent, stats->received);
+  if (stats->late)
+    eshPrintf(ctx, ", %d late", stats->late);
+
+  eshPrintf(ctx, ", %d%% loss\n",
+            stats->sent ? 100 * (stats->sent - stats->received - stats->late) / stats->sent : 0);
+
+  if (stats->samples == 0)
+    return;
+
+  eshPrintf(ctx, "rtt min/avg/max/mdev");
+  pingPrintMs(ctx, " = ", stats->min);
+  pingPrintMs(ctx, "/", statsAvg(stats));
+  pingPrintMs(ctx, "/", stats->max);
+  pingPrintMs(ctx, "/", statsMdev(stats));
+  eshPrintf(ctx, " ms\n");
 
+  for (i = 0; i < HIST_BUCKETS; i++)
+    if (stats->hist[i] > max)
+      max = stats->hist[i];
+
+  for (i = 0; i < HIST_BUCKETS; i++) {
+
+    if (stats->hist[i] == 0)
+      continue;
+
+    if (i < HIST_BUCKETS - 1)
+      eshPrintf(ctx, " <%7u us %6d ", (unsigned int)histLimits[i], stats->hist[i]);
+    else
+      eshPrintf(ctx, ">=%7u us %6d ", (unsigned int)histLimits[i - 1], stats->hist[i]);
+
+    for (bar = (stats->hist[i] * 40 + max - 1) / max; bar > 0; bar--)
+      eshPrintf(ctx, "#");
+
+    eshPrintf(ctx, "\n");
+  }
+}
+
+bool pingResolve(EshContext* ctx, const char* host, struct addrinfo** res)
+{
   struct addrinfo hints;
-  struct addrinfo *res;
-  int error;
 
   memset(&hints, '\0', sizeof(hints));
   hints.ai_family = AF_INET;
   hints.ai_socktype = SOCK_RAW;
   hints.ai_protocol = IPPROTO_ICMP;
 
-  error = getaddrinfo(host, NULL, &hints, &res);
-  if (error) {
+  if (getaddrinfo(host, NULL, &hints, res)) {
 
-    eshPrintf(ctx, "ping: unknown host %s\n", host);
+    eshPrintf(ctx, "%s: unknown host %s\n", ctx->argv[0], host);
+    return false;
+  }
+
+  return true;
+}
+
+int pingSocket(EshContext* ctx, uint32_t timeout)
+{
+  int s;
+
+  if ((s = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP)) < 0) {
+
+    eshPrintf(ctx, "%s: cannot create socket, error %d.\n", ctx->argv[0], errno);
     return -1;
   }
 
+  pingSetTimeout(s, timeout);
+  return s;
+}
+
+static void addTarget(SweepTarget* targets, int* count, uint32_t addr)
+{
+  memset(&targets[*count], '\0', sizeof(SweepTarget));
+  targets[*count].addr.s_addr = addr;
+  ++*count;
+}
+
+/*
+ * Add hosts to sweep target list. Argument is either
+ * host name/address or address range in a.b.c.d/n notation.
+ */
+static bool addTargets(EshContext* ctx, const char* arg, SweepTarget* targets, int* count)
+{
+  char host[20];
+  const char* slash;
+  struct addrinfo *res;
+  struct in_addr net;
+  uint32_t first;
+  uint32_t last;
+  uint32_t mask;
+  int prefix;
+
+  slash = strchr(arg, '/');
+  if (slash == NULL) {
+
+    if (*count >= ESHELLCFG_PING_SWEEP_MAX) {
+
+      eshPrintf(ctx, "ping: too many hosts, max %d.\n", ESHELLCFG_PING_SWEEP_MAX);
+      return false;
+    }
+
+    if (!pingResolve(ctx, arg, &res))
+      return false;
+
+    addTarget(targets, count, ((struct sockaddr_in*)(void*)res->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(res);
+    return true;
+  }
+
+  prefix = atoi(slash + 1);
+  if (slash - arg >= (int)sizeof(host))
+    prefix = -1;
+  else {
+
+    memcpy(host, arg, slash - arg);
+    host[slash - arg] = '\0';
+  }
+
+  if (prefix < 16 || prefix > 32 || !inet_aton(host, &net)) {
+
+    eshPrintf(ctx, "ping: bad address range %s\n", arg);
+    return false;
+  }
+
+  mask = prefix == 32 ? 0xFFFFFFFF : ~(0xFFFFFFFF >> prefix);
+  first = ntohl(net.s_addr) & mask;
+  last = first | ~mask;
+
+/*
+ * Skip network and broadcast addresses.
+ */
+  if (prefix < 31) {
+
+    ++first;
+    --last;
+  }
+
+  if (*count + (int)(last - first) >= ESHELLCFG_PING_SWEEP_MAX) {
+
+    eshPrintf(ctx, "ping: too many hosts, max %d.\n", ESHELLCFG_PING_SWEEP_MAX);
+    return false;
+  }
+
+  while (true) {
+
+    addTarget(targets, count, htonl(first));
+    if (first++ == last)
+      break;
+  }
+
+  return true;
+}
+
+/*
+ * Send echo requests to all targets in rounds,
+ * keeping them in flight concurrently on one socket.
+ * Replies are matched to targets by sequence number:
+ * seq = round * count + target index.
+ */
+static void sweepRun(EshContext* ctx, int s, PingPacket* packet, SweepTarget* targets, int count, int rounds, uint32_t interval)
+{
+  struct sockaddr_in to;
+  struct in_addr from;
+  uint16_t replyId;
+  uint16_t seq;
+  SweepTarget* t;
+  int round = 0;
+  int pending = 0;
+  int size = ctx->values[PING_ARG_SIZE].num;
+  uint32_t timeout = ctx->values[PING_ARG_TIMEOUT].num * 1000;
+  int i;
+  uint32_t now;
+  uint32_t deadline = eshMicros();
+
+  memset(&to, '\0', sizeof(to));
+  to.sin_family = AF_INET;
+
+  while (!eshCancelled(ctx)) {
+
+    now = eshMicros();
+    if (round < rounds && (int32_t)(now - deadline) >= 0) {
+
+      for (i = 0, t = targets; i < count; i++, t++) {
+
+        to.sin_addr = t->addr;
+        t->sent[round] = eshMicros();
+        if (pingSend(s, (struct sockaddr*)&to, sizeof(to), packet, size, round * count + i) >= 0) {
+
+          ++pending;
+          ++t->stats.sent;
+        }
+      }
+
+      ++round;
+      deadline = now + (round < rounds ? interval : timeout);
+    }
+
+    if (round == rounds && (pending == 0 || (int32_t)(now - deadline) >= 0))
+      break;
+
+    if (!pingReceiveAny(s, deadline, &from, &replyId, &seq) || replyId != packet->hdr.id)
+      continue;
+
+    if (seq >= rounds * count)
+      continue;
+
+    t = targets + seq % count;
+    if (t->addr.s_addr != from.s_addr || (t->replied & (1 << (seq / count))))
+      continue;
+
+    t->replied |= 1 << (seq / count);
+    --pending;
+
+    statsAdd(&t->stats, eshMicros() - t->sent[seq / count]);
+  }
+
+  eshPrintf(ctx, "%-16s %4s %4s %5s %s\n", "host", "sent", "recv", "loss", "min/avg/max ms");
+  for (i = 0, t = targets; i < count; i++, t++) {
+
+    eshPrintf(ctx, "%-16s %4d %4d %4d%%", inet_ntoa(t->addr), t->stats.sent, t->stats.received,
+              t->stats.sent ? 100 * (t->stats.sent - t->stats.received) / t->stats.sent : 0);
+
+    if (t->stats.received) {
+
+      pingPrintMs(ctx, " ", t->stats.min);
+      pingPrintMs(ctx, "/", statsAvg(&t->stats));
+      pingPrintMs(ctx, "/", t->stats.max);
+    }
+
+    eshPrintf(ctx, "\n");
+  }
+}
+
+static int sweep(EshContext* ctx, uint16_t id)
+{
+  SweepTarget* targets;
+  PingPacket* packet;
+  int count = 0;
+  int rounds = SWEEP_ROUNDS;
+  uint32_t interval = SWEEP_INTERVAL;
+  char* arg;
   int s;
-  struct timeval timeout;
 
-  timeout.tv_sec = 1;
-  timeout.tv_usec = 0;
+  if (ctx->values[PING_ARG_COUNT].present) {
+
+    rounds = ctx->values[PING_ARG_COUNT].num;
+    if (rounds > SWEEP_MAX_ROUNDS) {
+
+      eshPrintf(ctx, "ping: max count for sweep is %d.\n", SWEEP_MAX_ROUNDS);
+      return -1;
+    }
+  }
+
+  if (ctx->values[PING_ARG_INTERVAL].present)
+    interval = ctx->values[PING_ARG_INTERVAL].num * 1000;
+
+  targets = nosMemAlloc(ESHELLCFG_PING_SWEEP_MAX * sizeof(SweepTarget));
+  if (targets == NULL) {
+
+    eshPrintf(ctx, "%s: out of memory.\n", ctx->argv[0]);
+    return -1;
+  }
+
+  arg = ctx->values[PING_ARG_HOST].str;
+  do {
+
+    if (!addTargets(ctx, arg, targets, &count)) {
+
+      nosMemFree(targets);
+      return -1;
+    }
+
+  } while ((arg = eshNextArg(ctx, false)) != NULL);
+
+  packet = pingAlloc(ctx, id, ctx->values[PING_ARG_SIZE].num);
+  if (packet == NULL) {
+
+    nosMemFree(targets);
+    return -1;
+  }
+
+  s = pingSocket(ctx, ctx->values[PING_ARG_TIMEOUT].num * 1000);
+  if (s != -1) {
+
+    sweepRun(ctx, s, packet, targets, count, rounds, interval);
+    closesocket(s);
+  }
+
+  nosMemFree(packet);
+  nosMemFree(targets);
+  return 0;
+}
+
+/*
+ * Flood mode. Keeps up to window echo requests in flight,
+ * sending new one whenever reply arrives or an outstanding
+ * request times out.
+ */
+static void floodRun(EshContext* ctx, int s, const struct sockaddr* to, int toLen, PingPacket* packet)
+{
+  PingSlot* slots;
+  PingSlot* slot;
+  PingStats stats;
+  struct in_addr from;
+  uint16_t replyId;
+  uint16_t seq;
+  int window = ctx->values[PING_ARG_WINDOW].num;
+  int count = FLOOD_COUNT;
+  int size = ctx->values[PING_ARG_SIZE].num;
+  uint32_t timeout = ctx->values[PING_ARG_TIMEOUT].num * 1000;
+  int nextSeq = 0;
+  int outstanding = 0;
+  int sendErrors = 0;
+  int i;
+  uint32_t start;
+  uint32_t now;
+  uint32_t wait;
+  uint32_t elapsed;
+
+  if (ctx->values[PING_ARG_COUNT].present)
+    count = ctx->values[PING_ARG_COUNT].num;
+
+  slots = nosMemAlloc(window * sizeof(PingSlot));
+  if (slots == NULL) {
+
+    eshPrintf(ctx, "%s: out of memory.\n", ctx->argv[0]);
+    return;
+  }
+
+  memset(slots, '\0', window * sizeof(PingSlot));
+  memset(&stats, '\0', sizeof(stats));
+
+  start = eshMicros();
+  while (!eshCancelled(ctx)) {
+
+/*
+ * Fill window.
+ */
+    while (nextSeq < count && !slots[nextSeq % window].busy) {
+
+      slot = &slots[nextSeq % window];
+      slot->seq = nextSeq;
+      slot->sent = eshMicros();
+      if (pingSend(s, to, toLen, packet, size, nextSeq) < 0) {
+
+        ++sendErrors;
+        break;
+      }
+
+      slot->busy = true;
+      ++outstanding;
+      ++stats.sent;
+      ++nextSeq;
+    }
+
+/*
+ * Send failed and there is nothing to wait for,
+ * retrying would just spin.
+ */
+    if (outstanding == 0) {
+
+      if (nextSeq < count)
+        eshPrintf(ctx, "ping: send failed after %d requests.\n", nextSeq);
+
+      break;
+    }
+
+/*
+ * Expire requests that have not been answered in time,
+ * and find out how long to wait for next reply.
+ */
+    now = eshMicros();
+    wait = timeout;
+    for (i = 0, slot = slots; i < window; i++, slot++) {
+
+      if (!slot->busy)
+        continue;
+
+      if (now - slot->sent >= timeout) {
+
+        slot->busy = false;
+        --outstanding;
+      }
+      else if (timeout - (now - slot->sent) < wait)
+        wait = timeout - (now - slot->sent);
+    }
+
+    if (!pingReceiveAny(s, now + wait, &from, &replyId, &seq) || replyId != packet->hdr.id)
+      continue;
+
+    if (from.s_addr != ((const struct sockaddr_in*)(const void*)to)->sin_addr.s_addr || seq >= nextSeq)
+      continue;
+
+/*
+ * Reply to request that has already timed out.
+ * Its slot may have been reused, so round-trip time
+ * is not known.
+ */
+    slot = &slots[seq % window];
+    if (!slot->busy || slot->seq != seq) {
+
+      stats.late++;
+      continue;
+    }
+
+    statsAdd(&stats, eshMicros() - slot->sent);
+    slot->busy = false;
+    --outstanding;
+  }
+
+  elapsed = eshMicros() - start;
+  if (elapsed == 0)
+    elapsed = 1;
+
+  eshPrintf(ctx, "%u ms, %u requests/s, %u replies/s\n",
+            (unsigned int)(elapsed / 1000),
+            (unsigned int)((uint64_t)stats.sent * 1000000 / elapsed),
+            (unsigned int)((uint64_t)stats.received * 1000000 / elapsed));
+
+  if (sendErrors)
+    eshPrintf(ctx, "%d send errors\n", sendErrors);
+
+  statsPrint(ctx, &stats);
+  nosMemFree(slots);
+}
+
+static int ping(EshContext * ctx)
+{
+  char *host = ctx->values[PING_ARG_HOST].str;
+  uint16_t id = pingNextId();
+
+  if (ctx->values[PING_ARG_SWEEP].num) {
 
-  if ((s = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
+    if (ctx->values[PING_ARG_FLOOD].num) {
+
+      eshPrintf(ctx, "ping: --flood cannot be used with --sweep.\n");
+      ctx->error = EshBadArg;
+      return -1;
+    }
+
+    return sweep(ctx, id);
+  }
+
+  if (eshNextArg(ctx, false) != NULL) {
+
+    eshPrintf(ctx, "ping: multiple hosts need --sweep.\n");
+    return -1;
+  }
+
+  struct addrinfo *res;
+
+  if (!pingResolve(ctx, host, &res))
+    return -1;
+
+  int s;
+  PingPacket* packet;
+
+  if ((s = pingSocket(ctx, ctx->values[PING_ARG_TIMEOUT].num * 1000)) < 0) {
 
     freeaddrinfo(res);
-    eshPrintf(ctx, "ping: cannot create socket, error %d.\n", errno);
     return -1;
   }
 
-  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  packet = pingAlloc(ctx, id, ctx->values[PING_ARG_SIZE].num);
+  if (packet == NULL) {
+
+    closesocket(s);
+    freeaddrinfo(res);
+    return -1;
+  }
+
+  if (ctx->values[PING_ARG_FLOOD].num) {
+
+    eshPrintf(ctx, "%s: flood, window %d\n", host, ctx->values[PING_ARG_WINDOW].num);
+    eshFlush(ctx);
+    floodRun(ctx, s, res->ai_addr, res->ai_addrlen, packet);
+
+    closesocket(s);
+    nosMemFree(packet);
+    freeaddrinfo(res);
+    return 0;
+  }
 
   int i;
-  int okCount = 0;
-  int okJiffies = 0;
-  JIF_t start;
-  int max = 10;
+  int max = ctx->values[PING_ARG_COUNT].num;
+  int size = ctx->values[PING_ARG_SIZE].num;
+  uint32_t interval = ctx->values[PING_ARG_INTERVAL].num * 1000;
+  uint32_t timeout = ctx->values[PING_ARG_TIMEOUT].num * 1000;
+  uint32_t start;
+  uint32_t elapsed;
+  PingStats stats;
+  PingSlot history[PING_HISTORY];
+  PingSlot* slot;
   bool ok;
 
+  memset(&stats, '\0', sizeof(stats));
+  memset(history, '\0', sizeof(history));
+
   eshPrintf(ctx, "%s: ", host);
-  for (i = 0; i < max; i++) {
+  for (i = 0; i < max && !eshCancelled(ctx); i++) {
 
-    start = jiffies;
-    if (pingSend(s, res->ai_addr, res->ai_addrlen, i) >= 0) {
+    start = eshMicros();
+    if (pingSend(s, res->ai_addr, res->ai_addrlen, packet, size, i) >= 0) {
 
-      ok = pingReceive(s, res->ai_addr, res->ai_addrlen, i);
-      if (ok) {
+      slot = &history[i % PING_HISTORY];
+      slot->seq = i;
+      slot->sent = start;
+      slot->busy = true;
 
-        okCount++;
-        okJiffies += (jiffies - start);
-      }
+      stats.sent++;
+      ok = pingReceive(s, res->ai_addr, id, i, start + timeout, history, &stats);
 
       eshPrintf(ctx, "%s", ok ? "." : "!");
+      eshFlush(ctx);
     }
     else {
 
@@ -181,15 +911,16 @@ static int ping(EshContext * ctx)
       break;
     }
 
-    posTaskSleep(MS(500));
+    elapsed = eshMicros() - start;
+    if (i < max - 1 && elapsed < interval)
+      posTaskSleep(MS((interval - elapsed) / 1000));
   }
 
-  closesocket(s);
-  eshPrintf(ctx, " %d%% success", (int)((100.0 * okCount) / max));
-  if (okCount)
-    eshPrintf(ctx, ", avg delay %d ms", (int)(1000 * okJiffies / HZ / okCount));
+  eshPrintf(ctx, "\n");
+  statsPrint(ctx, &stats);
 
-  eshPrintf(ctx, ".\n");
+  closesocket(s);
+  nosMemFree(packet);
   freeaddrinfo(res);
   return 0;
 }
@@ -197,8 +928,9 @@ static int ping(EshContext * ctx)
 const EshCommand eshPingCommand = {
   .flags = 0,
   .name = "ping",
-  .help = "n.n.n.n",
-  .handler = ping
+  .help = "send icmp echo requests",
+  .handler = ping,
+  .args = pingArgs
 };
 
 #endif
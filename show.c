@@ -28,224 +28,534 @@
  * OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/*
+ * For register names in ucontext, used by prof on host.
+ */
+#define _GNU_SOURCE
+#endif
+
 #include <picoos.h>
 #include <picoos-u.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include "eshell.h"
+#include "eshell-hooks.h"
 
 #if UOSCFG_NEWLIB_SYSCALLS == 1 && NOSCFG_MEM_MANAGER_TYPE != 1
 #include <unistd.h>
 #endif
 
-#if defined(POS_DEBUGHELP)
+#if ESHELLCFG_PROF
+
+#ifndef ESHELLCFG_PROF_SIGPROF
+#if defined(__linux__)
+#define ESHELLCFG_PROF_SIGPROF 1
+#else
+#define ESHELLCFG_PROF_SIGPROF 0
+#endif
+#endif
+
+#if ESHELLCFG_PROF_SIGPROF
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#endif
+
+#endif
+
+#if POSCFG_ARGCHECK > 1 && (defined(POS_DEBUGHELP) || NOSCFG_FEATURE_REGISTRY)
 
 /*
- * Versions of 'show tasks' and 'show events' commands that dig
- * information out from pico]OS debug help structures.
+ * Unused stack is filled with PORT_STACK_MAGIC. Stack grows down,
+ * so free space is the run of magic bytes from stack base up.
+ * Free space only shrinks, so after first full scan the
+ * watermark is cached per task and later scans look only
+ * downwards from it, stopping after STACK_SCAN_RUN magic words.
+ * Large untouched locals below old watermark could hide deeper
+ * use from this, so every STACK_RESCAN'th scan is a full one.
+ * Each 'show tasks' pass stamps entries it uses with stackGen.
+ * Entry of a task that is listed later in current pass still
+ * carries previous stamp, so only entries missed by both
+ * current and previous pass are reused for new tasks.
+ * Stack of a task is freed as soon as it exits, so stack
+ * is scanned with scheduler locked. To keep scheduling latency
+ * low, lock is released after every STACK_SCAN_RUN words
+ * and task is checked to still exist when lock is taken again.
  */
+#define STACK_MAGIC_WORD ((unsigned int)PORT_STACK_MAGIC * (UINT_MAX / 0xFF))
+#define STACK_SCAN_RUN   32
+#define STACK_RESCAN     16
+#define STACK_WORD       sizeof(unsigned int)
+#define STACK_GONE       UINT_MAX
 
-static int ts(EshContext * ctx)
+#define ALIGN_UP(p)   ((const unsigned int*)(((uintptr_t)(p) + STACK_WORD - 1) & ~(uintptr_t)(STACK_WORD - 1)))
+
+typedef struct {
+
+  const void*          key;
+  const unsigned char* stack;
+  unsigned int         free;
+  unsigned int         gen;
+  unsigned int         scans;
+
+} StackMark;
+
+/*
+ * One extra entry for IRQ stack.
+ */
+static StackMark stackMarks[POSCFG_MAX_TASKS + 1];
+static unsigned int stackGen;
+
+/*
+ * Check that stack still belongs to task. Task handles
+ * point to pico]OS task table, so they can be looked
+ * at even if task has been deleted.
+ */
+static bool stackValid(const void* key, const unsigned char* stack)
 {
-  eshCheckNamedArgsUsed(ctx);
-  eshCheckArgsUsed(ctx);
-  if (eshArgError(ctx) != EshOK)
-    return -1;
+  if (key == (const void*)portIrqStack)
+    return true;
 
-  int taskCount = 0;
-  int i;
-  struct PICOTASK* task;
-  struct PICOTASK* allTasks[POSCFG_MAX_TASKS];
-  const char* name;
+#if POSCFG_FEATURE_TASKUNUSED
+  if (posTaskUnused((POSTASK_t)key))
+    return false;
+#endif
 
-  memset(allTasks, '\0', sizeof(allTasks));
+  return ((POSTASK_t)key)->stack == stack;
+}
 
+/*
+ * Let other tasks run between scan runs. Returns false
+ * if task has exited meanwhile.
+ */
+static bool stackYield(const void* key, const unsigned char* stack)
+{
+  posTaskSchedUnlock();
   posTaskSchedLock();
-  task = picodeb_tasklist;
-  while (task != NULL) {
+  return stackValid(key, stack);
+}
+
+static unsigned int scanUp(const void* key, const unsigned char* base, unsigned int size)
+{
+  const unsigned char* sp = base;
+  const unsigned char* end = base + size;
+  const unsigned int* wp;
+  int run = 0;
+
+  while (sp < end && (const unsigned int*)sp != ALIGN_UP(sp) && *sp == PORT_STACK_MAGIC)
+    ++sp;
+
+  if ((const unsigned int*)sp == ALIGN_UP(sp)) {
 
-    allTasks[taskCount] = task;
-    taskCount++;
-    task = task->next;
+    wp = (const unsigned int*)sp;
+    while ((const unsigned char*)(wp + 1) <= end && *wp == STACK_MAGIC_WORD) {
+
+      ++wp;
+      if (++run == STACK_SCAN_RUN) {
+
+        if (!stackYield(key, base))
+          return STACK_GONE;
+
+        run = 0;
+      }
+    }
+
+    sp = (const unsigned char*)wp;
   }
 
-#if POSCFG_ARGCHECK > 1
+  while (sp < end && *sp == PORT_STACK_MAGIC)
+    ++sp;
+
+  return sp - base;
+}
 
-    int freeStack;
-    unsigned char* sp;
+static unsigned int scanDown(const void* key, const unsigned char* base, unsigned int known)
+{
+  const unsigned char* mark = base + known;
+  const unsigned char* low = mark;
+  const unsigned char* sp;
+  const unsigned int* first = ALIGN_UP(base);
+  const unsigned int* wp = ALIGN_UP(mark);
+  int run = 0;
+  int words = 0;
 
-#endif
+  while (wp > first && run < STACK_SCAN_RUN) {
 
-  posTaskSchedUnlock();
+    --wp;
+    if (*wp != STACK_MAGIC_WORD) {
 
-  for (i = 0; i < taskCount; i++) {
+      low = (const unsigned char*)wp;
+      run = 0;
+    }
+    else
+      ++run;
 
-    task = allTasks[i];
+    if (++words == STACK_SCAN_RUN) {
 
-    if (task->state == task_notExisting)
-      continue;
+      if (!stackYield(key, base))
+        return STACK_GONE;
 
-    name = (task->name != NULL) ? task->name : "?";
+      words = 0;
+    }
+  }
 
-#if POSCFG_ARGCHECK > 1
+/*
+ * Reached stack base, check bytes before first full word.
+ */
+  if (run < STACK_SCAN_RUN) {
+
+    for (sp = base; sp < (const unsigned char*)first && sp < low; sp++) {
 
-    freeStack = 0;
+      if (*sp != PORT_STACK_MAGIC) {
 
-    sp = task->handle->stack;
-    while (*sp == PORT_STACK_MAGIC) {
-      ++sp;
-      ++freeStack;
+        low = sp;
+        break;
+      }
     }
+  }
 
-    eshPrintf(ctx, "%08X %s %d\n", task->handle, name, freeStack);
-#else
-    eshPrintf(ctx, "%08X %s\n", task->handle, name);
-#endif
+  for (sp = low; sp < mark && *sp == PORT_STACK_MAGIC; sp++)
+    ;
+
+  return sp - base;
+}
+
+/*
+ * Returns free bytes in stack, or STACK_GONE if
+ * task has exited.
+ */
+static unsigned int stackFree(const void* key, const unsigned char* stack, unsigned int size)
+{
+  StackMark* m = NULL;
+  StackMark* spare = NULL;
+  unsigned int known;
+  unsigned int freeBytes;
+  int i;
+
+  posTaskSchedLock();
+  if (!stackValid(key, stack)) {
+
+    posTaskSchedUnlock();
+    return STACK_GONE;
   }
 
-  eshPrintf(ctx, "%d tasks, %d conf max.\n", taskCount, POSCFG_MAX_TASKS);
+  for (i = 0; i < POSCFG_MAX_TASKS + 1; i++) {
 
-#if POSCFG_ARGCHECK > 1
+    if (stackMarks[i].key == key && stackMarks[i].stack == stack) {
 
-  sp = portIrqStack;
-  while (*sp == PORT_STACK_MAGIC) {
-    ++sp;
-    ++freeStack;
+      m = &stackMarks[i];
+      break;
+    }
+
+    if (spare == NULL && (stackMarks[i].key == NULL || stackGen - stackMarks[i].gen > 1))
+      spare = &stackMarks[i];
   }
 
-  eshPrintf(ctx, "IRQ stack free %d\n", freeStack);
-#endif
+  if (m == NULL && spare != NULL) {
 
-#if UOSCFG_NEWLIB_SYSCALLS == 1 && NOSCFG_MEM_MANAGER_TYPE != 1
+    m = spare;
+    m->key = key;
+    m->stack = stack;
+    m->free = size;
+    m->scans = 0;
+  }
 
-  uint32_t heapUsed = (char*)sbrk(0) - (char*)__heap_start;
-  uint32_t heapSize = (char*)__heap_end - (char*)__heap_start;
-  eshPrintf(ctx, "Heap used: %u (%d %%)\n", heapUsed, 100 * heapUsed / heapSize);
+  known = size;
+  if (m != NULL) {
+
+    m->gen = stackGen;
+    if (++m->scans % STACK_RESCAN != 0)
+      known = m->free;
+  }
+
+  freeBytes = known >= size ? scanUp(key, stack, size) : scanDown(key, stack, known);
+
+/*
+ * Entry may have been reused while lock was released.
+ */
+  if (freeBytes != STACK_GONE && m != NULL && m->key == key && m->stack == stack && freeBytes < m->free)
+    m->free = freeBytes;
+
+  posTaskSchedUnlock();
+  return freeBytes;
+}
+
+static void printStack(EshContext* ctx, const void* key, const unsigned char* stack, unsigned int size)
+{
+  unsigned int freeBytes = stackFree(key, stack, size);
+
+  if (freeBytes == STACK_GONE)
+    eshPrintf(ctx, " %6u %6s %4s\n", size, "-", "-");
+  else
+    eshPrintf(ctx, " %6u %6u %3u%%\n", size, freeBytes, size ? 100 * (size - freeBytes) / size : 0);
+}
 
 #endif
 
-  return 0;
+#if defined(POS_DEBUGHELP) || NOSCFG_FEATURE_REGISTRY
+
+/*
+ * Snapshot of task and event lists. Needed fields are copied
+ * into a table first and formatted only afterwards, so that
+ * objects deleted meanwhile are not touched and lists are
+ * held locked only for the copy.
+ */
+#define SNAP_NAME 16
+
+typedef struct {
+
+  const void* handle;
+  char        name[SNAP_NAME];
+  const char* state;
+  int         prio;
+  const unsigned char* stack;
+  unsigned int stackSize;
+
+} TaskSnap;
+
+typedef struct {
+
+  const void* handle;
+  char        name[SNAP_NAME];
+  const char* type;
+  unsigned int counter;
+
+} EventSnap;
+
+static void snapName(char* buf, const char* name)
+{
+  strncpy(buf, name != NULL ? name : "?", SNAP_NAME - 1);
+  buf[SNAP_NAME - 1] = '\0';
 }
 
-static int es(EshContext * ctx)
+static void snapTask(TaskSnap* snap, POSTASK_t task, const char* name)
 {
-  eshCheckNamedArgsUsed(ctx);
-  eshCheckArgsUsed(ctx);
-  if (eshArgError(ctx) != EshOK)
-    return -1;
+  snap->handle = task;
+  snapName(snap->name, name);
+  snap->state = NULL;
+#if POSCFG_FEATURE_GETPRIORITY
+  snap->prio = posTaskGetPriority(task);
+#else
+  snap->prio = -1;
+#endif
+#if POSCFG_ARGCHECK > 1
+  snap->stack = task->stack;
+  snap->stackSize = task->stackSize;
+#endif
+}
 
-  int eventCount = 0;
-  int i;
-  struct PICOEVENT* event;
-  struct PICOEVENT* allEvents[POSCFG_MAX_EVENTS];
-  const char* name;
-  const char* typeName;
+#endif
+
+#if defined(POS_DEBUGHELP)
+
+/*
+ * Snapshot from pico]OS debug help structures.
+ */
+#define SNAP_TASKS  "tasks"
+#define SNAP_EVENTS "events"
+#define SNAP_EVENT_COUNTER 1
 
-  memset(allEvents, '\0', sizeof(allEvents));
+static const char* taskState(const struct PICOTASK* task)
+{
+  switch (task->state) {
+  case task_created:
+    return "created";
+
+  case task_running:
+    return "running";
+
+  case task_suspended:
+    return "suspended";
+
+  case task_sleeping:
+    return "sleeping";
+
+  default:
+    return "waiting";
+  }
+}
+
+static int snapTasks(TaskSnap* snap, int max)
+{
+  struct PICOTASK* task;
+  int count = 0;
 
   posTaskSchedLock();
-  event = picodeb_eventlist;
-  while (event != NULL) {
+  for (task = picodeb_tasklist; task != NULL && count < max; task = task->next) {
+
+    if (task->state == task_notExisting)
+      continue;
 
-    allEvents[eventCount] = event;
-    eventCount++;
-    event = event->next;
+    snapTask(&snap[count], task->handle, task->name);
+    snap[count].state = taskState(task);
+    count++;
   }
 
   posTaskSchedUnlock();
+  return count;
+}
 
-  for (i = 0; i < eventCount; i++) {
+static int snapEvents(EventSnap* snap, int max)
+{
+  struct PICOEVENT* event;
+  int count = 0;
+
+  posTaskSchedLock();
+  for (event = picodeb_eventlist; event != NULL && count < max; event = event->next) {
 
-    event = allEvents[i];
+    snap[count].handle = event->handle;
+    snapName(snap[count].name, event->name);
+    snap[count].counter = event->counter;
 
     switch (event->type) {
     case event_semaphore:
-      typeName = "sem";
+      snap[count].type = "sem";
       break;
 
     case event_mutex:
-      typeName = "mutex";
+      snap[count].type = "mutex";
       break;
 
     case event_flags:
-      typeName = "flag";
+      snap[count].type = "flag";
       break;
 
+    default:
+      snap[count].type = "?";
+      break;
     }
 
-    name = (event->name != NULL) ? event->name : "?";
-    eshPrintf(ctx, "%06X %-5s %s 0x%X\n", event->handle, typeName, name, event->counter);
+    count++;
   }
 
-
-  eshPrintf(ctx, "%d events, %d conf max.\n", eventCount, POSCFG_MAX_EVENTS);
-  return 0;
+  posTaskSchedUnlock();
+  return count;
 }
 
 #elif NOSCFG_FEATURE_REGISTRY
 
 /*
- * Alternative versions of 'show tasks' and 'show events' commands that dig
- * information out from pico]OS registry. This has less runtime
+ * Snapshot from pico]OS registry. This has less runtime
  * performance impacts than the version using debug help stuff.
  * The downside is that only nano-layer objects are reported.
+ * Registry is walked without printing anything, so
+ * it is kept locked only for the copy.
  */
-static int ts(EshContext * ctx)
+#define SNAP_TASKS  "nano tasks + idle task"
+#define SNAP_EVENTS "nano events"
+#define SNAP_EVENT_COUNTER 0
+
+static int snapTasks(TaskSnap* snap, int max)
 {
-  eshCheckNamedArgsUsed(ctx);
-  eshCheckArgsUsed(ctx);
-  if (eshArgError(ctx) != EshOK)
-    return -1;
+  NOSREGQHANDLE_t q;
+  NOSGENERICHANDLE_t h;
+  char name[SNAP_NAME];
+  int count = 0;
+
+  q = nosRegQueryBegin(REGTYPE_TASK);
+  while (count < max && nosRegQueryElem(q, &h, name, sizeof(name)) == E_OK) {
+
+    snapTask(&snap[count], (POSTASK_t)h, name);
+    count++;
+  }
 
-  int taskCount = 0;
+  nosRegQueryEnd(q);
+  return count;
+}
 
+static int snapEventType(EventSnap* snap, int max, int type, const char* typeName)
+{
   NOSREGQHANDLE_t q;
   NOSGENERICHANDLE_t h;
-  POSTASK_t task;
-  char name[80];
+  int count = 0;
 
-#if POSCFG_ARGCHECK > 1
+  q = nosRegQueryBegin(type);
+  while (count < max && nosRegQueryElem(q, &h, snap[count].name, SNAP_NAME) == E_OK) {
 
-  int freeStack;
-  unsigned char* sp;
+    snap[count].handle = h;
+    snap[count].type = typeName;
+    snap[count].counter = 0;
+    count++;
+  }
 
-#endif
+  nosRegQueryEnd(q);
+  return count;
+}
 
-  q = nosRegQueryBegin(REGTYPE_TASK);
-  while (nosRegQueryElem(q, &h, name, sizeof(name)) == E_OK) {
+static int snapEvents(EventSnap* snap, int max)
+{
+  int count = 0;
 
-    task = (POSTASK_t)h;
-    taskCount++;
+#if NOSCFG_FEATURE_SEMAPHORES
+  count += snapEventType(snap + count, max - count, REGTYPE_SEMAPHORE, "sem");
+#endif
 
-#if POSCFG_ARGCHECK > 1
+#if NOSCFG_FEATURE_FLAGS
+  count += snapEventType(snap + count, max - count, REGTYPE_FLAG, "flag");
+#endif
 
-    freeStack = 0;
+#if NOSCFG_FEATURE_MUTEXES
+  count += snapEventType(snap + count, max - count, REGTYPE_MUTEX, "mutex");
+#endif
 
-    sp = task->stack;
-    while (*sp == PORT_STACK_MAGIC) {
-      ++sp;
-      ++freeStack;
-    }
+  return count;
+}
 
-    eshPrintf(ctx, "%08X %s %d\n", task, name, freeStack);
-#else
-    eshPrintf(ctx, "%08X %s\n", task, name);
 #endif
+
+#if defined(POS_DEBUGHELP) || NOSCFG_FEATURE_REGISTRY
+
+/*
+ * Versions of 'show tasks' and 'show events' commands that
+ * format a snapshot of task and event lists.
+ */
+static int ts(EshContext * ctx)
+{
+  TaskSnap* snap;
+  TaskSnap* task;
+  int taskCount;
+  int i;
+
+  snap = nosMemAlloc(POSCFG_MAX_TASKS * sizeof(TaskSnap));
+  if (snap == NULL) {
+
+    eshPrintf(ctx, "ts: out of memory.\n");
+    return -1;
   }
 
-  nosRegQueryEnd(q);
+#if POSCFG_ARGCHECK > 1
+  posTaskSchedLock();
+  stackGen++;
+  posTaskSchedUnlock();
+#endif
 
-  eshPrintf(ctx, "%d nano tasks + idle task, %d conf max.\n", taskCount, POSCFG_MAX_TASKS);
+  taskCount = snapTasks(snap, POSCFG_MAX_TASKS);
 
 #if POSCFG_ARGCHECK > 1
+  eshPrintf(ctx, "%-8s %-16s %-9s %4s %6s %6s %4s\n", "task", "name", "state", "prio", "stack", "free", "used");
+#endif
 
-  sp = portIrqStack;
-  while (*sp == PORT_STACK_MAGIC) {
-    ++sp;
-    ++freeStack;
+  for (i = 0; i < taskCount; i++) {
+
+    task = &snap[i];
+    eshPrintf(ctx, "%08X %-16s %-9s %4d", task->handle, task->name, task->state ? task->state : "-", task->prio);
+
+#if POSCFG_ARGCHECK > 1
+    printStack(ctx, task->handle, task->stack, task->stackSize);
+#else
+    eshPrintf(ctx, "\n");
+#endif
   }
 
-  eshPrintf(ctxm "IRQ stack free %d\n", freeStack);
+  eshPrintf(ctx, "%d " SNAP_TASKS ", %d conf max.\n", taskCount, POSCFG_MAX_TASKS);
+  nosMemFree(snap);
+
+#if POSCFG_ARGCHECK > 1
+  eshPrintf(ctx, "%08X %-16s %-9s %4s", portIrqStack, "IRQ", "", "");
+  printStack(ctx, portIrqStack, portIrqStack, PORTCFG_IRQ_STACK_SIZE);
 #endif
 
 #if UOSCFG_NEWLIB_SYSCALLS == 1 && NOSCFG_MEM_MANAGER_TYPE != 1
@@ -255,68 +565,901 @@ static int ts(EshContext * ctx)
   eshPrintf(ctx, "Heap used: %u (%d %%)\n", heapUsed, 100 * heapUsed / heapSize);
 
 #endif
+
   return 0;
 }
 
-static int listEvents(EshContext* ctx, int type, const char* typeName)
+#if ESHELLCFG_EVENT_STATS
+
+/*
+ * Contention statistics for events. Application locks
+ * mutexes and waits semaphores through eshMutexLock(),
+ * eshMutexUnlock() and eshSemaGet() wrappers, which
+ * record how often and how long tasks had to wait.
+ * Uncontended path is a non-blocking try, so that
+ * only real waits are timed. Semaphores are not released
+ * by owner, so hold time is tracked only for mutexes.
+ * Events should be destroyed with eshMutexDestroy() and
+ * eshSemaDestroy(), which free the slot, otherwise a new
+ * event that gets the same handle inherits old statistics.
+ * When table is full, events are counted as dropped.
+ */
+#ifndef ESHELLCFG_EVENT_STATS_MAX
+#define ESHELLCFG_EVENT_STATS_MAX POSCFG_MAX_EVENTS
+#endif
+
+typedef struct {
+
+  const void* handle;
+  POSTASK_t   owner;
+  uint32_t    count;
+  uint32_t    waits;
+  uint64_t    totalWait;
+  uint32_t    maxWait;
+  uint32_t    maxHold;
+  uint32_t    lockedAt;
+  int         depth;
+
+} EventStat;
+
+static EventStat eventStats[ESHELLCFG_EVENT_STATS_MAX];
+static uint32_t eventStatsDropped;
+
+/*
+ * Find statistics slot for event, allocating a new
+ * one if needed. Caller must hold scheduler lock.
+ */
+static EventStat* eventStat(const void* handle)
 {
-  NOSREGQHANDLE_t q;
-  NOSGENERICHANDLE_t h;
-  char name[80];
-  int eventCount = 0;
+  EventStat* spare = NULL;
+  int i;
 
-  q = nosRegQueryBegin(type);
-  while (nosRegQueryElem(q, &h, name, sizeof(name)) == E_OK) {
+  for (i = 0; i < ESHELLCFG_EVENT_STATS_MAX; i++) {
 
-    eventCount++;
-    eshPrintf(ctx, "%06X %-5s %s\n", h, typeName, name);
+    if (eventStats[i].handle == handle)
+      return &eventStats[i];
+
+    if (spare == NULL && eventStats[i].handle == NULL)
+      spare = &eventStats[i];
   }
 
-  nosRegQueryEnd(q);
-  return eventCount;
+  if (spare == NULL) {
+
+    eventStatsDropped++;
+    return NULL;
+  }
+
+  spare->handle = handle;
+  return spare;
 }
 
-static int es(EshContext * ctx)
+static void eventDestroyed(const void* handle)
 {
-  eshCheckNamedArgsUsed(ctx);
-  eshCheckArgsUsed(ctx);
-  if (eshArgError(ctx) != EshOK)
-    return -1;
-
-  int eventCount = 0;
+  int i;
 
-#if NOSCFG_FEATURE_SEMAPHORES
-  eventCount += listEvents(ctx, REGTYPE_SEMAPHORE, "sem");
-#endif
+  posTaskSchedLock();
+  for (i = 0; i < ESHELLCFG_EVENT_STATS_MAX; i++) {
 
-#if NOSCFG_FEATURE_FLAGS
-  eventCount += listEvents(ctx, REGTYPE_FLAG, "flag");
-#endif
+    if (eventStats[i].handle == handle) {
 
-#if NOSCFG_FEATURE_MUTEXES
-  eventCount += listEvents(ctx, REGTYPE_MUTEX, "mutex");
-#endif
+      memset(&eventStats[i], '\0', sizeof(EventStat));
+      break;
+    }
+  }
 
-  eshPrintf(ctx, "%d nano events, %d conf max.\n", eventCount, POSCFG_MAX_EVENTS);
-  return 0;
+  posTaskSchedUnlock();
 }
 
-#endif
+static void eventAcquired(const void* handle, uint32_t start, bool waited, bool owned)
+{
+  EventStat* stat;
+  uint32_t now = eshMicros();
 
-#if defined(POS_DEBUGHELP) || NOSCFG_FEATURE_REGISTRY
+  posTaskSchedLock();
+  stat = eventStat(handle);
+  if (stat != NULL) {
 
-const EshCommand eshTsCommand = {
-  .flags = 0,
-  .name = "ts",
-  .help = "show tasks",
-  .handler = ts
-};
+    stat->count++;
+    if (waited) {
 
-const EshCommand eshEsCommand = {
-  .flags = 0,
+      uint32_t wait = now - start;
+
+      stat->waits++;
+      stat->totalWait += wait;
+      if (wait > stat->maxWait)
+        stat->maxWait = wait;
+    }
+
+    if (owned && stat->depth++ == 0)
+      stat->lockedAt = now;
+
+    stat->owner = posTaskGetCurrent();
+  }
+
+  posTaskSchedUnlock();
+}
+
+#if POSCFG_FEATURE_MUTEXES
+
+void eshMutexLock(POSMUTEX_t mutex)
+{
+  uint32_t start;
+
+  if (posMutexTryLock(mutex) == 0) {
+
+    eventAcquired(mutex, 0, false, true);
+    return;
+  }
+
+  start = eshMicros();
+  posMutexLock(mutex);
+  eventAcquired(mutex, start, true, true);
+}
+
+void eshMutexUnlock(POSMUTEX_t mutex)
+{
+  EventStat* stat;
+  uint32_t hold;
+
+  posTaskSchedLock();
+  stat = eventStat(mutex);
+  if (stat != NULL && stat->depth > 0 && --stat->depth == 0) {
+
+    hold = eshMicros() - stat->lockedAt;
+    if (hold > stat->maxHold)
+      stat->maxHold = hold;
+  }
+
+  posTaskSchedUnlock();
+  posMutexUnlock(mutex);
+}
+
+#if POSCFG_FEATURE_MUTEXDESTROY
+
+void eshMutexDestroy(POSMUTEX_t mutex)
+{
+  eventDestroyed(mutex);
+  posMutexDestroy(mutex);
+}
+
+#endif
+#endif
+
+#if POSCFG_FEATURE_SEMAPHORES
+
+void eshSemaGet(POSSEMA_t sema)
+{
+  uint32_t start;
+
+#if POSCFG_FEATURE_SEMAWAIT
+  if (posSemaWait(sema, 0) == 0) {
+
+    eventAcquired(sema, 0, false, false);
+    return;
+  }
+#endif
+
+  start = eshMicros();
+  posSemaGet(sema);
+  eventAcquired(sema, start, true, false);
+}
+
+#if POSCFG_FEATURE_SEMADESTROY
+
+void eshSemaDestroy(POSSEMA_t sema)
+{
+  eventDestroyed(sema);
+  posSemaDestroy(sema);
+}
+
+#endif
+
+#endif
+
+static const char* esTaskName(const TaskSnap* tasks, int taskCount, POSTASK_t task)
+{
+  int i;
+
+  for (i = 0; i < taskCount; i++)
+    if (tasks[i].handle == task)
+      return tasks[i].name;
+
+  return "?";
+}
+
+static void esStats(EshContext* ctx, const EventSnap* snap, int eventCount)
+{
+  EventStat* stats;
+  EventStat tmp;
+  TaskSnap* tasks;
+  int taskCount;
+  int count;
+  uint32_t dropped;
+  const char* type;
+  const char* name;
+  int i;
+  int j;
+
+  stats = nosMemAlloc(sizeof(eventStats));
+  tasks = nosMemAlloc(POSCFG_MAX_TASKS * sizeof(TaskSnap));
+  if (stats == NULL || tasks == NULL) {
+
+    eshPrintf(ctx, "es: out of memory.\n");
+    if (stats != NULL)
+      nosMemFree(stats);
+
+    if (tasks != NULL)
+      nosMemFree(tasks);
+
+    return;
+  }
+
+/*
+ * Copy used slots, destroyed events leave holes in table.
+ */
+  count = 0;
+  posTaskSchedLock();
+  for (i = 0; i < ESHELLCFG_EVENT_STATS_MAX; i++)
+    if (eventStats[i].handle != NULL)
+      stats[count++] = eventStats[i];
+
+  dropped = eventStatsDropped;
+  posTaskSchedUnlock();
+
+  taskCount = snapTasks(tasks, POSCFG_MAX_TASKS);
+
+/*
+ * Most waited event first.
+ */
+  for (i = 1; i < count; i++) {
+
+    tmp = stats[i];
+    for (j = i; j > 0 && stats[j - 1].totalWait < tmp.totalWait; j--)
+      stats[j] = stats[j - 1];
+
+    stats[j] = tmp;
+  }
+
+  eshPrintf(ctx, "%-6s %-5s %-16s %8s %8s %10s %8s %8s %s\n",
+            "event", "type", "name", "count", "waits", "total us", "max us", "hold us", "owner");
+
+  for (i = 0; i < count; i++) {
+
+    type = "?";
+    name = "?";
+    for (j = 0; j < eventCount; j++) {
+
+      if (snap[j].handle == stats[i].handle) {
+
+        type = snap[j].type;
+        name = snap[j].name;
+        break;
+      }
+    }
+
+    eshPrintf(ctx, "%06X %-5s %-16s %8u %8u %10llu %8u %8u %s\n",
+              stats[i].handle, type, name,
+              stats[i].count, stats[i].waits, (unsigned long long)stats[i].totalWait,
+              stats[i].maxWait, stats[i].maxHold,
+              stats[i].owner ? esTaskName(tasks, taskCount, stats[i].owner) : "-");
+  }
+
+  eshPrintf(ctx, "%d events with statistics, %d conf max.\n", count, ESHELLCFG_EVENT_STATS_MAX);
+  if (dropped)
+    eshPrintf(ctx, "%u acquisitions not counted, table full.\n", (unsigned int)dropped);
+
+  nosMemFree(stats);
+  nosMemFree(tasks);
+}
+
+#endif
+
+enum {
+  ES_ARG_STATS
+};
+
+static const EshArgSpec esArgs[] = {
+
+  { .name = "stats", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "show contention statistics" },
+  { .name = NULL }
+};
+
+static int es(EshContext * ctx)
+{
+  EventSnap* snap;
+  EventSnap* event;
+  int eventCount;
+  int i;
+
+  snap = nosMemAlloc(POSCFG_MAX_EVENTS * sizeof(EventSnap));
+  if (snap == NULL) {
+
+    eshPrintf(ctx, "es: out of memory.\n");
+    return -1;
+  }
+
+  eventCount = snapEvents(snap, POSCFG_MAX_EVENTS);
+  if (ctx->values[ES_ARG_STATS].num) {
+
+#if ESHELLCFG_EVENT_STATS
+    esStats(ctx, snap, eventCount);
+    nosMemFree(snap);
+    return 0;
+#else
+    eshPrintf(ctx, "es: --stats needs ESHELLCFG_EVENT_STATS.\n");
+    nosMemFree(snap);
+    return -1;
+#endif
+  }
+
+  for (i = 0; i < eventCount; i++) {
+
+    event = &snap[i];
+#if SNAP_EVENT_COUNTER
+    eshPrintf(ctx, "%06X %-5s %s 0x%X\n", event->handle, event->type, event->name, event->counter);
+#else
+    eshPrintf(ctx, "%06X %-5s %s\n", event->handle, event->type, event->name);
+#endif
+  }
+
+  eshPrintf(ctx, "%d " SNAP_EVENTS ", %d conf max.\n", eventCount, POSCFG_MAX_EVENTS);
+  nosMemFree(snap);
+  return 0;
+}
+
+const EshCommand eshTsCommand = {
+
+  .flags = 0,
+  .name = "ts",
+  .help = "show tasks",
+  .handler = ts,
+  .args = eshNoArgs
+};
+
+const EshCommand eshEsCommand = {
+  .flags = 0,
   .name = "es",
   .help = "show events",
-  .handler = es
+  .handler = es,
+  .args = esArgs
+};
+
+#if ESHELLCFG_TOP
+
+/*
+ * CPU usage accounting for top. Application calls eshTopTick()
+ * from its timer interrupt and tick is charged to task that
+ * was running. If port can call eshTopSwitch() from context
+ * switch, switches are counted too. Nothing is counted
+ * unless top is running, slot table is cleared at start
+ * of each interval so that handles of deleted tasks are recycled.
+ */
+#ifndef ESHELLCFG_TOP_SWITCH_HOOK
+#define ESHELLCFG_TOP_SWITCH_HOOK 0
+#endif
+
+#define TOP_SLOTS (POSCFG_MAX_TASKS + 1)
+#define TOP_IDLE  "idle task"
+
+typedef struct {
+
+  POSTASK_t task;
+  uint32_t  ticks;
+  uint32_t  switches;
+
+} TopSlot;
+
+static TopSlot topSlots[TOP_SLOTS];
+static int topLast;
+static uint32_t topTicks;
+static uint32_t topSwitches;
+static volatile bool topActive;
+
+static TopSlot* topSlot(POSTASK_t task)
+{
+  int i;
+
+  if (topSlots[topLast].task == task)
+    return &topSlots[topLast];
+
+/*
+ * Slots are filled in order and cleared all at once,
+ * so first free one means that task is not in table yet.
+ */
+  for (i = 0; i < TOP_SLOTS; i++) {
+
+    if (topSlots[i].task == task || topSlots[i].task == NULL) {
+
+      topSlots[i].task = task;
+      topLast = i;
+      return &topSlots[i];
+    }
+  }
+
+  return NULL;
+}
+
+void eshTopTick(void)
+{
+  TopSlot* slot;
+
+  if (!topActive)
+    return;
+
+  topTicks++;
+  slot = topSlot(posTaskGetCurrent());
+  if (slot != NULL)
+    slot->ticks++;
+}
+
+#if ESHELLCFG_TOP_SWITCH_HOOK
+void eshTopSwitch(POSTASK_t next)
+{
+  TopSlot* slot;
+
+  if (!topActive)
+    return;
+
+  topSwitches++;
+  slot = topSlot(next);
+  if (slot != NULL)
+    slot->switches++;
+}
+#endif
+
+/*
+ * Copy counters and start a new interval. Hooks run
+ * from interrupt or scheduler, so lock out interrupts
+ * for the copy.
+ */
+static void topSample(TopSlot* slots, uint32_t* ticks, uint32_t* switches)
+{
+  POS_LOCKFLAGS;
+
+  POS_SCHED_LOCK;
+  memcpy(slots, topSlots, sizeof(topSlots));
+  *ticks = topTicks;
+  *switches = topSwitches;
+  memset(topSlots, '\0', sizeof(topSlots));
+  topLast = 0;
+  topTicks = 0;
+  topSwitches = 0;
+  POS_SCHED_UNLOCK;
+}
+
+static const char* topName(const TaskSnap* snap, int taskCount, POSTASK_t task)
+{
+  int i;
+
+  for (i = 0; i < taskCount; i++)
+    if (snap[i].handle == task)
+      return snap[i].name;
+
+  return "(exited)";
+}
+
+static void topPrint(EshContext* ctx, const TaskSnap* snap, int taskCount, TopSlot* slots,
+                     uint32_t ticks, uint32_t switches, uint32_t usecs)
+{
+  TopSlot tmp;
+  const char* name;
+  uint32_t idle = 0;
+  int count;
+  int i;
+  int j;
+
+  for (count = 0; count < TOP_SLOTS && slots[count].task != NULL; count++)
+    ;
+
+/*
+ * Busiest task first.
+ */
+  for (i = 1; i < count; i++) {
+
+    tmp = slots[i];
+    for (j = i; j > 0 && slots[j - 1].ticks < tmp.ticks; j--)
+      slots[j] = slots[j - 1];
+
+    slots[j] = tmp;
+  }
+
+  for (i = 0; i < count; i++)
+    if (!strcmp(topName(snap, taskCount, slots[i].task), TOP_IDLE))
+      idle += slots[i].ticks;
+
+  if (ticks == 0)
+    ticks = 1;
+
+  eshPrintf(ctx, "\n%u.%u s, %u ticks", usecs / 1000000, usecs / 100000 % 10, ticks);
+#if ESHELLCFG_TOP_SWITCH_HOOK
+  eshPrintf(ctx, ", %u switches", switches);
+#endif
+  eshPrintf(ctx, ", idle %u%%\n", 100 * idle / ticks);
+
+  eshPrintf(ctx, "%-8s %-16s %6s", "task", "name", "cpu");
+#if ESHELLCFG_TOP_SWITCH_HOOK
+  eshPrintf(ctx, " %8s", "switches");
+#endif
+  eshPrintf(ctx, "\n");
+
+  for (i = 0; i < count; i++) {
+
+    name = topName(snap, taskCount, slots[i].task);
+    eshPrintf(ctx, "%08X %-16s %3u.%u%%", slots[i].task, name,
+              100 * slots[i].ticks / ticks, 1000 * slots[i].ticks / ticks % 10);
+#if ESHELLCFG_TOP_SWITCH_HOOK
+    eshPrintf(ctx, " %8u", slots[i].switches);
+#endif
+    eshPrintf(ctx, "\n");
+  }
+}
+
+enum {
+  TOP_ARG_INTERVAL,
+  TOP_ARG_COUNT
+};
+
+static const EshArgSpec topArgs[] = {
+
+  { .name = "interval", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 3600, .def = 1, .help = "sampling interval, seconds" },
+  { .name = "count", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 0, .max = 10000, .def = 1, .help = "number of reports, 0 until interrupted" },
+  { .name = NULL }
+};
+
+static int top(EshContext* ctx)
+{
+  int seconds = ctx->values[TOP_ARG_INTERVAL].num;
+  int reports = ctx->values[TOP_ARG_COUNT].num;
+  TaskSnap* snap;
+  TopSlot* slots;
+  int taskCount;
+  uint32_t ticks;
+  uint32_t switches;
+  uint32_t start;
+  uint32_t now;
+  int n;
+  int i;
+
+  posTaskSchedLock();
+  if (topActive) {
+
+    posTaskSchedUnlock();
+    eshPrintf(ctx, "top: already running in another session.\n");
+    return -1;
+  }
+
+  topActive = true;
+  posTaskSchedUnlock();
+
+  snap = nosMemAlloc(POSCFG_MAX_TASKS * sizeof(TaskSnap));
+  slots = nosMemAlloc(sizeof(topSlots));
+  if (snap == NULL || slots == NULL) {
+
+    eshPrintf(ctx, "top: out of memory.\n");
+    topActive = false;
+    if (snap != NULL)
+      nosMemFree(snap);
+
+    if (slots != NULL)
+      nosMemFree(slots);
+
+    return -1;
+  }
+
+  topSample(slots, &ticks, &switches);
+  start = eshMicros();
+
+  for (n = 0; reports == 0 || n < reports; n++) {
+
+    for (i = 0; i < seconds * 10 && !eshCancelled(ctx); i++)
+      posTaskSleep(MS(100));
+
+    topSample(slots, &ticks, &switches);
+    now = eshMicros();
+    taskCount = snapTasks(snap, POSCFG_MAX_TASKS);
+
+    topPrint(ctx, snap, taskCount, slots, ticks, switches, now - start);
+    eshFlush(ctx);
+    start = now;
+    if (eshCancelled(ctx))
+      break;
+  }
+
+  topActive = false;
+  nosMemFree(snap);
+  nosMemFree(slots);
+  return 0;
+}
+
+const EshCommand eshTopCommand = {
+  .flags = 0,
+  .name = "top",
+  .help = "show cpu usage of tasks",
+  .handler = top,
+  .args = topArgs
+};
+
+#endif
+
+#endif
+
+#if ESHELLCFG_PROF
+
+/*
+ * Statistical profiler. Application calls eshProfSample()
+ * from a periodic timer interrupt with program counter
+ * of interrupted code (on Cortex-M it is in exception
+ * stack frame). On a host build SIGPROF timer is used instead.
+ * Samples are counted in a small hash table, indexed by
+ * PC >> ESHELLCFG_PROF_SHIFT.
+ */
+#ifndef ESHELLCFG_PROF_SLOTS
+#define ESHELLCFG_PROF_SLOTS 256
+#endif
+
+#ifndef ESHELLCFG_PROF_SHIFT
+#define ESHELLCFG_PROF_SHIFT 2
+#endif
+
+#if ESHELLCFG_PROF_SLOTS & (ESHELLCFG_PROF_SLOTS - 1)
+#error ESHELLCFG_PROF_SLOTS must be power of two
+#endif
+
+#define PROF_PROBES 8
+
+typedef struct {
+
+  uintptr_t key;
+  uint32_t  count;
+
+} ProfSlot;
+
+static ProfSlot profSlots[ESHELLCFG_PROF_SLOTS];
+static uint32_t profSamples;
+static uint32_t profDropped;
+static volatile bool profActive;
+
+void eshProfSample(const void* pc)
+{
+  uintptr_t key;
+  unsigned int h;
+  int i;
+
+  if (!profActive)
+    return;
+
+  profSamples++;
+  key = (uintptr_t)pc >> ESHELLCFG_PROF_SHIFT;
+  h = (unsigned int)key * 2654435761U;
+  for (i = 0; i < PROF_PROBES; i++) {
+
+    ProfSlot* slot = &profSlots[(h + i) & (ESHELLCFG_PROF_SLOTS - 1)];
+
+    if (slot->count == 0)
+      slot->key = key;
+
+    if (slot->key == key) {
+
+      slot->count++;
+      return;
+    }
+  }
+
+  profDropped++;
+}
+
+#if ESHELLCFG_PROF_SIGPROF
+
+static void profSignal(int sig, siginfo_t* info, void* uc)
+{
+  const mcontext_t* mc = &((ucontext_t*)uc)->uc_mcontext;
+
+#if defined(__x86_64__)
+  eshProfSample((const void*)mc->gregs[REG_RIP]);
+#elif defined(__i386__)
+  eshProfSample((const void*)mc->gregs[REG_EIP]);
+#elif defined(__aarch64__)
+  eshProfSample((const void*)mc->pc);
+#elif defined(__arm__)
+  eshProfSample((const void*)mc->arm_pc);
+#else
+  eshProfSample(NULL);
+#endif
+}
+
+/*
+ * Sample at 1 kHz using process cpu time.
+ */
+static void profTimer(bool on)
+{
+  struct sigaction sa;
+  struct itimerval it;
+
+  memset(&it, '\0', sizeof(it));
+  if (on) {
+
+    memset(&sa, '\0', sizeof(sa));
+    sa.sa_sigaction = profSignal;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, NULL);
+
+    it.it_interval.tv_usec = 1000;
+    it.it_value.tv_usec = 1000;
+  }
+
+  setitimer(ITIMER_PROF, &it, NULL);
+}
+
+#endif
+
+#if ESHELLCFG_PROF_SYMBOLS
+
+/*
+ * Find symbol whose range contains address. Table
+ * is sorted by address, symbol extends to next one.
+ */
+static int profSymbol(int symbolCount, uintptr_t addr)
+{
+  int lo = 0;
+  int hi = symbolCount - 1;
+  int mid;
+
+  if (symbolCount == 0 || addr < eshSymbolTable[0].addr)
+    return -1;
+
+  while (lo < hi) {
+
+    mid = (lo + hi + 1) / 2;
+    if (eshSymbolTable[mid].addr <= addr)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  return lo;
+}
+
+#endif
+
+enum {
+  PROF_ARG_TIME,
+  PROF_ARG_TOP
+};
+
+static const EshArgSpec profArgs[] = {
+
+  { .name = "time", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 3600, .def = 5, .help = "sampling time, seconds" },
+  { .name = "top", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 100, .def = 20, .help = "number of entries to show" },
+  { .name = NULL }
+};
+
+static int prof(EshContext* ctx)
+{
+  int seconds = ctx->values[PROF_ARG_TIME].num;
+  int top = ctx->values[PROF_ARG_TOP].num;
+  ProfSlot* slots;
+  ProfSlot tmp;
+  int count;
+  int best;
+  int i;
+  int j;
+
+  posTaskSchedLock();
+  if (profActive) {
+
+    posTaskSchedUnlock();
+    eshPrintf(ctx, "prof: already running in another session.\n");
+    return -1;
+  }
+
+  memset(profSlots, '\0', sizeof(profSlots));
+  profSamples = 0;
+  profDropped = 0;
+  profActive = true;
+  posTaskSchedUnlock();
+
+#if ESHELLCFG_PROF_SIGPROF
+  profTimer(true);
+#endif
+
+  for (i = 0; i < seconds * 10 && !eshCancelled(ctx); i++)
+    posTaskSleep(MS(100));
+
+#if ESHELLCFG_PROF_SIGPROF
+  profTimer(false);
+#endif
+
+/*
+ * Sampler runs in interrupt, so it has finished
+ * by the time this task runs again.
+ */
+  profActive = false;
+
+  slots = nosMemAlloc(sizeof(profSlots));
+  if (slots == NULL) {
+
+    eshPrintf(ctx, "prof: out of memory.\n");
+    return -1;
+  }
+
+  count = 0;
+  for (i = 0; i < ESHELLCFG_PROF_SLOTS; i++)
+    if (profSlots[i].count)
+      slots[count++] = profSlots[i];
+
+#if ESHELLCFG_PROF_SYMBOLS
+
+/*
+ * Fold samples into symbol ranges. Key of
+ * slot is replaced by symbol index.
+ */
+  int symbolCount;
+  int sym;
+
+  for (symbolCount = 0; eshSymbolTable[symbolCount].name != NULL; symbolCount++)
+    ;
+
+  for (i = 0; i < count; i++)
+    slots[i].key = profSymbol(symbolCount, slots[i].key << ESHELLCFG_PROF_SHIFT);
+
+  for (i = 0; i < count; i++) {
+
+    for (j = 0; j < i; j++) {
+
+      if (slots[j].key == slots[i].key) {
+
+        slots[j].count += slots[i].count;
+        slots[i] = slots[--count];
+        i--;
+        break;
+      }
+    }
+  }
+
+#endif
+
+  eshPrintf(ctx, "%u samples, %u dropped.\n", profSamples, profDropped);
+  eshPrintf(ctx, "%8s %6s  %s\n", "samples", "%", "address");
+
+/*
+ * Select busiest entries.
+ */
+  for (i = 0; i < count && i < top; i++) {
+
+    best = i;
+    for (j = i + 1; j < count; j++)
+      if (slots[j].count > slots[best].count)
+        best = j;
+
+    tmp = slots[i];
+    slots[i] = slots[best];
+    slots[best] = tmp;
+
+    eshPrintf(ctx, "%8u %3u.%u%%  ", slots[i].count,
+              100 * slots[i].count / profSamples, 1000 * slots[i].count / profSamples % 10);
+
+#if ESHELLCFG_PROF_SYMBOLS
+    sym = (int)slots[i].key;
+    if (sym >= 0)
+      eshPrintf(ctx, "%08lX %s\n", (unsigned long)eshSymbolTable[sym].addr, eshSymbolTable[sym].name);
+    else
+      eshPrintf(ctx, "%8s ?\n", "");
+#else
+    eshPrintf(ctx, "%08lX\n", (unsigned long)(slots[i].key << ESHELLCFG_PROF_SHIFT));
+#endif
+  }
+
+  nosMemFree(slots);
+  return 0;
+}
+
+const EshCommand eshProfCommand = {
+  .flags = 0,
+  .name = "prof",
+  .help = "sample program counter",
+  .handler = prof,
+  .args = profArgs
 };
 
 #endif
@@ -42,6 +42,8 @@
 #if ESHELLCFG_LWIP
 
 #include <picoos-lwip.h>
+#include "eshell-commands.h"
+
 static void telnetd(void*);
 
 #define STATE_NORMAL 0
@@ -54,6 +56,7 @@ static void telnetd(void*);
 #define STATE_CR     7
 
 #define TELNET_IAC   255
+#define TELNET_IP    244
 #define TELNET_WILL  251
 #define TELNET_WONT  252
 #define TELNET_DO    253
@@ -64,33 +67,126 @@ static void telnetd(void*);
 #define OPT_LINEMODE 34
 
 
+/*
+ * Output is encoded into a buffer of this size
+ * before passing it to socket.
+ */
+#ifndef ESHELLCFG_TELNET_TXBUF
+#define ESHELLCFG_TELNET_TXBUF 128
+#endif
+
+/*
+ * If ESHELLCFG_TELNETD_SELECT is set, all sessions are
+ * served by telnetd task using select() instead of
+ * creating a task for each connection. Telnetd task
+ * only handles input and line editing, commands are run by
+ * a pool of ESHELLCFG_TELNETD_WORKERS tasks, so that a
+ * long-running command doesn't block other sessions.
+ * By default there is a worker for each session. With fewer
+ * workers a command waits for a free one if all are busy,
+ * and session is told that command was queued.
+ * Session contexts are allocated from a pool of
+ * ESHELLCFG_TELNETD_SESSIONS slots. Connections are
+ * refused when pool is full.
+ */
+#ifndef ESHELLCFG_TELNETD_SELECT
+#define ESHELLCFG_TELNETD_SELECT 0
+#endif
+
+#ifndef ESHELLCFG_TELNETD_SESSIONS
+#define ESHELLCFG_TELNETD_SESSIONS 4
+#endif
+
+#ifndef ESHELLCFG_TELNETD_WORKERS
+#define ESHELLCFG_TELNETD_WORKERS ESHELLCFG_TELNETD_SESSIONS
+#endif
+
+/*
+ * Socket writes give up after this many seconds, so
+ * that a client that stops reading cannot block
+ * telnetd or a worker forever.
+ */
+#ifndef ESHELLCFG_TELNETD_SEND_TIMEOUT
+#define ESHELLCFG_TELNETD_SEND_TIMEOUT 10
+#endif
+
+#define TELNET_LINE_MAX   80
+#define TELNET_IDLE_TIME  MS(60000)
+
 static void telnetFunc(EshContext* ctx, const char* buf)
 {
-  const unsigned char* ptr = (const unsigned char*)buf;
+  const char* ptr = buf;
+  char tx[ESHELLCFG_TELNET_TXBUF];
+  int len = 0;
+  int run;
+  int n;
 
   while (*ptr) {
 
     if (ctx->telnet.crState) { // CR state
 
       if (*ptr != '\n')
-        write(ctx->telnet.sock, "\0", 1);
+        tx[len++] = '\0';
 
        ctx->telnet.crState = 0;
     }
 
-    if (*ptr == TELNET_IAC)
-      write(ctx->telnet.sock, ptr, 1);
+/*
+ * Copy run of characters that need no special handling.
+ */
+    run = strcspn(ptr, "\r\n\377");
+    while (run > 0) {
 
-    if (*ptr == '\n')
-      write(ctx->telnet.sock, "\r\n", 2);
-    else
-      write(ctx->telnet.sock, ptr, 1);
+      n = sizeof(tx) - len;
+      if (n > run)
+        n = run;
 
-    if (*ptr == '\r')
+      memcpy(tx + len, ptr, n);
+      len += n;
+      ptr += n;
+      run -= n;
+
+      if (len == sizeof(tx)) {
+
+        write(ctx->telnet.sock, tx, len);
+        len = 0;
+      }
+    }
+
+    if (*ptr == '\0')
+      break;
+
+/*
+ * Ensure there is room for escaped character
+ * and possible CR-NUL.
+ */
+    if (len > (int)sizeof(tx) - 3) {
+
+      write(ctx->telnet.sock, tx, len);
+      len = 0;
+    }
+
+    if (*ptr == (char)TELNET_IAC) {
+
+      tx[len++] = TELNET_IAC;
+      tx[len++] = TELNET_IAC;
+    }
+    else if (*ptr == '\n') {
+
+      tx[len++] = '\r';
+      tx[len++] = '\n';
+    }
+    else {
+
+      tx[len++] = '\r';
       ctx->telnet.crState = 1;
+    }
 
     ++ptr;
   }
+
+  if (len > 0)
+    write(ctx->telnet.sock, tx, len);
 }
 
 static void sendOpt(EshContext* ctx, uint8_t option, uint8_t value)
@@ -104,156 +200,668 @@ static void sendOpt(EshContext* ctx, uint8_t option, uint8_t value)
   write(ctx->telnet.sock, buf, 3);
 }
 
-static bool inputFunc(EshContext* ctx, char* data, int max)
+/*
+ * Get next character from session receive buffer.
+ * Buffer is refilled with one read when it becomes
+ * empty, so characters that arrive together are
+ * processed without extra socket calls. Pending echo
+ * output is flushed before blocking.
+ */
+static bool fillRx(EshContext* ctx)
 {
-  uint8_t c;
-  int len = 0;
-  bool gotLine = false;
-  max = max - 1;
+  int len;
 
-  do {
-    
-    if (read(ctx->telnet.sock, &c, 1) < 1)
-      return false;
+  eshFlush(ctx);
+  len = read(ctx->telnet.sock, ctx->telnet.rxBuf, sizeof(ctx->telnet.rxBuf));
+  if (len < 1)
+    return false;
+
+  ctx->telnet.rxPos = 0;
+  ctx->telnet.rxLen = len;
+  return true;
+}
+
+static bool readChar(EshContext* ctx, uint8_t* c)
+{
+  if (ctx->telnet.rxPos >= ctx->telnet.rxLen && !fillRx(ctx))
+    return false;
+
+  *c = ctx->telnet.rxBuf[ctx->telnet.rxPos++];
+  return true;
+}
 
-    switch (ctx->telnet.state)
-    {
+/*
+ * Look for Ctrl-C or IAC IP in received bytes. Telnet
+ * commands may be split across reads, so IAC state is
+ * kept between calls. Option bytes after WILL/WONT/DO/DONT
+ * are skipped, so that they are not mistaken for Ctrl-C.
+ */
+static bool scanInterrupt(EshContext* ctx, const uint8_t* buf, int len)
+{
+  int i;
+
+  for (i = 0; i < len; i++) {
+
+    switch (ctx->telnet.scanState) {
     case STATE_IAC:
-      if (c == TELNET_IAC) {
+      if (buf[i] == TELNET_IP)
+        return true;
 
-        *data = c;
-        if (ctx->telnet.echo)
-          write(ctx->telnet.sock, data, 1);
+      if (buf[i] >= TELNET_WILL && buf[i] <= TELNET_DONT)
+        ctx->telnet.scanState = STATE_WILL;
+      else
+        ctx->telnet.scanState = STATE_NORMAL;
 
-        data++;
-        ++len;
+      break;
 
-        ctx->telnet.state = STATE_NORMAL;
-      }
-      else {
+    case STATE_WILL:
+      ctx->telnet.scanState = STATE_NORMAL;
+      break;
 
-        switch (c)
-        {
-        case TELNET_WILL:
-          ctx->telnet.state = STATE_WILL;
-          break;
+    default:
+      if (buf[i] == TELNET_IAC)
+        ctx->telnet.scanState = STATE_IAC;
+      else if (buf[i] == 3)
+        return true;
 
-        case TELNET_WONT:
-          ctx->telnet.state = STATE_WONT;
-          break;
+      break;
+    }
+  }
 
-        case TELNET_DO:
-          ctx->telnet.state = STATE_DO;
-          break;
+  return false;
+}
 
-        case TELNET_DONT:
-          ctx->telnet.state = STATE_DONT;
-          break;
+/*
+ * Check for interrupt while command is running.
+ * Available input is read without blocking into
+ * receive buffer and scanned for Ctrl-C or IAC IP.
+ * Scanning starts where line reader stopped, with
+ * its telnet state. When receive buffer is full, further
+ * input is read into a scratch buffer, scanned and
+ * dropped, so that interrupt is seen even after
+ * lot of input has been typed ahead.
+ * Input typed ahead of interrupt is discarded.
+ */
+static void pollFunc(EshContext* ctx)
+{
+  uint8_t scratch[16];
+  uint8_t* buf = ctx->telnet.rxBuf;
+  bool found;
+  int len;
 
-        default:
-          ctx->telnet.state = STATE_NORMAL;
-          break;
-        }
-      }
+  if (ctx->telnet.rxScan < 0) {
+
+    ctx->telnet.rxScan = ctx->telnet.rxPos;
+    switch (ctx->telnet.state) {
+    case STATE_IAC:
+      ctx->telnet.scanState = STATE_IAC;
       break;
 
     case STATE_WILL:
-      /* Reply with a DONT */
-      sendOpt(ctx, TELNET_DONT, c);
-      ctx->telnet.state = STATE_NORMAL;
+    case STATE_WONT:
+    case STATE_DO:
+    case STATE_DONT:
+      ctx->telnet.scanState = STATE_WILL;
       break;
 
-    case STATE_WONT:
-      /* Reply with a DONT */
-      sendOpt(ctx, TELNET_DONT, c);
-      ctx->telnet.state = STATE_NORMAL;
+    default:
+      ctx->telnet.scanState = STATE_NORMAL;
       break;
+    }
+  }
 
-    case STATE_DO:
-      if (c == OPT_SGA) {
+  if (ctx->telnet.rxPos > 0) {
 
-        if (!ctx->telnet.sga)
-          sendOpt(ctx, TELNET_WILL, c);
+    memmove(buf, buf + ctx->telnet.rxPos, ctx->telnet.rxLen - ctx->telnet.rxPos);
+    ctx->telnet.rxLen -= ctx->telnet.rxPos;
+    ctx->telnet.rxScan -= ctx->telnet.rxPos;
+    ctx->telnet.rxPos = 0;
+  }
 
-        ctx->telnet.sga = true;
-      }
-      else if (c == OPT_ECHO) {
+  len = sizeof(ctx->telnet.rxBuf) - ctx->telnet.rxLen;
+  if (len > 0) {
 
-        ctx->telnet.echo = true;
-      }
-      else {
+    len = recv(ctx->telnet.sock, buf + ctx->telnet.rxLen, len, MSG_DONTWAIT);
+    if (len > 0)
+      ctx->telnet.rxLen += len;
 
-        /* Reply with a WONT */
-        sendOpt(ctx, TELNET_WONT, c);
-      }
+    found = scanInterrupt(ctx, buf + ctx->telnet.rxScan, ctx->telnet.rxLen - ctx->telnet.rxScan);
+    ctx->telnet.rxScan = ctx->telnet.rxLen;
+  }
+  else {
+
+    found = false;
+    while (!found && (len = recv(ctx->telnet.sock, scratch, sizeof(scratch), MSG_DONTWAIT)) > 0)
+      found = scanInterrupt(ctx, scratch, len);
+  }
+
+  if (len == 0) {
+
+/*
+ * Connection closed, no point to continue.
+ */
+    ctx->cancelled = true;
+    return;
+  }
+
+  if (found) {
+
+    ctx->cancelled = true;
+    ctx->telnet.rxLen = 0;
+    ctx->telnet.rxScan = 0;
+    ctx->telnet.state = STATE_NORMAL;
+  }
+}
+
+/*
+ * Run received character through telnet state machine.
+ * Returns true when input line is complete.
+ */
+static bool inputChar(EshContext* ctx, uint8_t c, char* data, int* len)
+{
+  bool gotLine = false;
+
+/*
+ * Line reader is active, pollFunc must restart
+ * scanning from its state.
+ */
+  ctx->telnet.rxScan = -1;
+
+  switch (ctx->telnet.state)
+  {
+  case STATE_IAC:
+    if (c == TELNET_IAC) {
+
+      data[*len] = c;
+      if (ctx->telnet.echo)
+        eshPrintf(ctx, "%c", c);
+
+      ++*len;
 
       ctx->telnet.state = STATE_NORMAL;
-      break;
+    }
+    else {
+
+      switch (c)
+      {
+      case TELNET_WILL:
+        ctx->telnet.state = STATE_WILL;
+        break;
+
+      case TELNET_WONT:
+        ctx->telnet.state = STATE_WONT;
+        break;
+
+      case TELNET_DO:
+        ctx->telnet.state = STATE_DO;
+        break;
+
+      case TELNET_DONT:
+        ctx->telnet.state = STATE_DONT;
+        break;
+
+      case TELNET_IP:
+        eshPrintf(ctx, "^C");
+        *len = 0;
+        gotLine = true;
+        ctx->telnet.state = STATE_NORMAL;
+        break;
+
+      default:
+        ctx->telnet.state = STATE_NORMAL;
+        break;
+      }
+    }
+    break;
+
+  case STATE_WILL:
+    /* Reply with a DONT */
+    sendOpt(ctx, TELNET_DONT, c);
+    ctx->telnet.state = STATE_NORMAL;
+    break;
+
+  case STATE_WONT:
+    /* Reply with a DONT */
+    sendOpt(ctx, TELNET_DONT, c);
+    ctx->telnet.state = STATE_NORMAL;
+    break;
+
+  case STATE_DO:
+    if (c == OPT_SGA) {
+
+      if (!ctx->telnet.sga)
+        sendOpt(ctx, TELNET_WILL, c);
+
+      ctx->telnet.sga = true;
+    }
+    else if (c == OPT_ECHO) {
+
+      ctx->telnet.echo = true;
+    }
+    else {
 
-    case STATE_DONT:
       /* Reply with a WONT */
       sendOpt(ctx, TELNET_WONT, c);
-      ctx->telnet.state = STATE_NORMAL;
-      break;
+    }
 
-    case STATE_CR:
-      ctx->telnet.state = STATE_NORMAL;
-      gotLine = true;
-      break;
+    ctx->telnet.state = STATE_NORMAL;
+    break;
 
-    case STATE_NORMAL:
-      if (c == TELNET_IAC) {
+  case STATE_DONT:
+    /* Reply with a WONT */
+    sendOpt(ctx, TELNET_WONT, c);
+    ctx->telnet.state = STATE_NORMAL;
+    break;
 
-        ctx->telnet.state = STATE_IAC;
-      }
-      else if (c == '\r') {
+  case STATE_CR:
+    ctx->telnet.state = STATE_NORMAL;
+    gotLine = true;
+    break;
 
-        ctx->telnet.state = STATE_CR;
+  case STATE_NORMAL:
+    if (c == TELNET_IAC) {
+
+      ctx->telnet.state = STATE_IAC;
+    }
+    else if (c == '\r') {
+
+      ctx->telnet.state = STATE_CR;
+    }
+    else {
+
+      if (c == '\n') {
+
+        gotLine = true;
       }
       else {
 
-        if (c == '\n') {
+        if (c == 3) {
 
+          eshPrintf(ctx, "^C");
+          *len = 0;
           gotLine = true;
         }
-        else {
-
-          if (c == 127) {
+        else if (c == 127) {
 
-            if (len > 0) {
+          if (*len > 0) {
 
-              write(ctx->telnet.sock, "\010 \010", 3);
-              --data;
-              --len;
-            }
+            eshPrintf(ctx, "\010 \010");
+            --*len;
           }
-          else {
+        }
+        else if (c == '\0') {
 
-            *data = c;
-            if (ctx->telnet.echo)
-              write(ctx->telnet.sock, data, 1);
+/*
+ * Nul would terminate both input line and
+ * echo output, which are C strings.
+ */
+        }
+        else {
 
-            data++;
-            ++len;
-          }
+          data[*len] = c;
+          if (ctx->telnet.echo)
+            eshPrintf(ctx, "%c", c);
+
+          ++*len;
         }
       }
-      break;
     }
+    break;
+  }
+
+  return gotLine;
+}
+
+static bool inputFunc(EshContext* ctx, char* data, int max)
+{
+  uint8_t c;
+  int len = 0;
+  bool gotLine = false;
+  max = max - 1;
+
+  do {
+    
+    if (!readChar(ctx, &c))
+      return false;
+
+    gotLine = inputChar(ctx, c, data, &len);
 
   } while(!gotLine && len < max - 1);
 
-  *data = '\0';
-  write(ctx->telnet.sock, "\r\n", 2);
+  data[len] = '\0';
+  eshPrintf(ctx, "\n");
 
   return true;
 }
 
-static void tcpClientThread(void* arg)
+static void sessionStart(EshContext* ctx, int sock)
 {
-  int sock = (int)arg;
-  char buf[80];
+  struct timeval tv;
+
+  tv.tv_sec = ESHELLCFG_TELNETD_SEND_TIMEOUT;
+  tv.tv_usec = 0;
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  memset(ctx, '\0', sizeof(EshContext));
+  ctx->telnet.sock = sock;
+  ctx->output = telnetFunc;
+  ctx->input = inputFunc;
+  ctx->poll = pollFunc;
+  ctx->telnet.state  = STATE_NORMAL;
+  ctx->telnet.rxScan = -1;
+  ctx->remote = true;
+
+  sendOpt(ctx, TELNET_WILL, OPT_ECHO);
+  eshPrintf(ctx, "Pico]OS " POS_VER_S "\n");
+}
+
+/*
+ * Session slot. Line being received is kept here, so in
+ * select mode session can be resumed whenever more input
+ * arrives.
+ */
+#define RUN_IDLE   0
+#define RUN_QUEUED 1
+#define RUN_ACTIVE 2
+#define RUN_DONE   3
+
+typedef struct {
+
+  bool       inUse;
   EshContext ctx;
+  char       line[TELNET_LINE_MAX];
+  int        lineLen;
+  JIF_t      lastInput;
+  volatile int run;
+  int        status;
+
+} TelnetSession;
+
+static TelnetSession sessions[ESHELLCFG_TELNETD_SESSIONS];
+static int sessionsInUse;
+static int sessionsPeak;
+static unsigned int sessionsAccepted;
+static unsigned int sessionsRejected;
+
+static TelnetSession* sessionAlloc()
+{
+  TelnetSession* s;
+  int i;
+
+  posTaskSchedLock();
+  for (i = 0, s = sessions; i < ESHELLCFG_TELNETD_SESSIONS; i++, s++)
+    if (!s->inUse)
+      break;
+
+  if (i < ESHELLCFG_TELNETD_SESSIONS) {
+
+    s->inUse = true;
+    s->lineLen = 0;
+    s->run = RUN_IDLE;
+    s->lastInput = jiffies;
+
+    ++sessionsAccepted;
+    if (++sessionsInUse > sessionsPeak)
+      sessionsPeak = sessionsInUse;
+  }
+  else {
+
+    ++sessionsRejected;
+    s = NULL;
+  }
+
+  posTaskSchedUnlock();
+  return s;
+}
+
+static void sessionFree(TelnetSession* s)
+{
+  posTaskSchedLock();
+  s->inUse = false;
+  --sessionsInUse;
+  posTaskSchedUnlock();
+}
+
+static void sessionReject(int sock)
+{
+  static const char msg[] = "Too many sessions.\r\n";
+
+  write(sock, msg, sizeof(msg) - 1);
+  close(sock);
+}
+
+#if ESHELLCFG_TELNETD_SELECT
+
+static NOSSEMA_t workSema;
+static int workers;
+
+static void sessionClose(TelnetSession* s)
+{
+  eshFlush(&s->ctx);
+  close(s->ctx.telnet.sock);
+  sessionFree(s);
+}
+
+static void sessionPrompt(TelnetSession* s)
+{
+  eshPrintf(&s->ctx, "esh> ");
+  eshFlush(&s->ctx);
+}
+
+/*
+ * Check if all workers are running or about to run
+ * a command.
+ */
+static bool workersBusy(void)
+{
+  TelnetSession* s;
+  int i;
+  int busy = 0;
+
+  for (i = 0, s = sessions; i < ESHELLCFG_TELNETD_SESSIONS; i++, s++)
+    if (s->inUse && (s->run == RUN_QUEUED || s->run == RUN_ACTIVE))
+      ++busy;
+
+  return busy >= workers;
+}
+
+/*
+ * Run received characters through line editor until
+ * a complete line is found. Line is then passed to a
+ * worker and rest of input is left in receive buffer
+ * until command has completed.
+ */
+static void sessionProcess(TelnetSession* s)
+{
+  EshContext* ctx = &s->ctx;
+  uint8_t c;
+
+  while (ctx->telnet.rxPos < ctx->telnet.rxLen) {
+
+    c = ctx->telnet.rxBuf[ctx->telnet.rxPos++];
+    if (!inputChar(ctx, c, s->line, &s->lineLen) && s->lineLen < (int)sizeof(s->line) - 3)
+      continue;
+
+    s->line[s->lineLen] = '\0';
+    s->lineLen = 0;
+    eshPrintf(ctx, "\n");
+    if (workersBusy())
+      eshPrintf(ctx, "Busy, command queued.\n");
+
+    eshFlush(ctx);
+
+    s->run = RUN_QUEUED;
+    nosSemaSignal(workSema);
+    return;
+  }
+
+  eshFlush(ctx);
+}
+
+/*
+ * Read data that is available in session socket.
+ */
+static void sessionInput(TelnetSession* s)
+{
+  if (!fillRx(&s->ctx)) {
+
+    sessionClose(s);
+    return;
+  }
+
+  s->lastInput = jiffies;
+  sessionProcess(s);
+}
+
+/*
+ * Command has completed in worker. Close session
+ * if it was exit, otherwise prompt and continue with
+ * input that arrived while command was running.
+ */
+static void sessionDone(TelnetSession* s)
+{
+  s->run = RUN_IDLE;
+  s->lastInput = jiffies;
+  if (s->status == 0) {
+
+    sessionClose(s);
+    return;
+  }
+
+  sessionPrompt(s);
+  sessionProcess(s);
+}
+
+static void telnetWorker(void* arg)
+{
+  TelnetSession* s;
+  int i;
+
+  for(;;) {
+
+    nosSemaGet(workSema);
+
+    posTaskSchedLock();
+    for (i = 0, s = sessions; i < ESHELLCFG_TELNETD_SESSIONS; i++, s++) {
+
+      if (s->inUse && s->run == RUN_QUEUED) {
+
+        s->run = RUN_ACTIVE;
+        break;
+      }
+    }
+
+    posTaskSchedUnlock();
+    if (i == ESHELLCFG_TELNETD_SESSIONS)
+      continue;
+
+/*
+ * Session socket belongs to worker until
+ * command is done, telnetd doesn't touch it.
+ */
+    s->status = eshParse(&s->ctx, s->line);
+    s->run = RUN_DONE;
+  }
+}
+
+static void telnetd(void* arg)
+{
+  int listenSock = (int)arg;
+  int sock;
+  int maxSock;
+  int i;
+  bool running;
+  TelnetSession* s;
+  fd_set readSet;
+  struct timeval tv;
+
+  for(;;) {
+
+    FD_ZERO(&readSet);
+    FD_SET(listenSock, &readSet);
+    maxSock = listenSock;
+    running = false;
+
+    for (i = 0, s = sessions; i < ESHELLCFG_TELNETD_SESSIONS; i++, s++) {
+
+      if (!s->inUse)
+        continue;
+
+      if (s->run != RUN_IDLE) {
+
+        running = true;
+        continue;
+      }
+
+      FD_SET(s->ctx.telnet.sock, &readSet);
+      if (s->ctx.telnet.sock > maxSock)
+        maxSock = s->ctx.telnet.sock;
+    }
+
+/*
+ * Worker cannot wake up select, so poll more
+ * often while commands are running.
+ */
+    tv.tv_sec = running ? 0 : 1;
+    tv.tv_usec = running ? 100000 : 0;
+
+    if (select(maxSock + 1, &readSet, NULL, NULL, &tv) < 0) {
+
+      printf("telnetd: select failed.\n");
+      posTaskSleep(MS(1000));
+      continue;
+    }
+
+/*
+ * Serve sessions that have input or completed
+ * command, close idle ones.
+ */
+    for (i = 0, s = sessions; i < ESHELLCFG_TELNETD_SESSIONS; i++, s++) {
+
+      if (!s->inUse)
+        continue;
+
+      if (s->run == RUN_DONE)
+        sessionDone(s);
+      else if (s->run != RUN_IDLE)
+        continue;
+      else if (FD_ISSET(s->ctx.telnet.sock, &readSet))
+        sessionInput(s);
+      else if (jiffies - s->lastInput >= TELNET_IDLE_TIME)
+        sessionClose(s);
+    }
+
+/*
+ * Accept new connection.
+ */
+    if (FD_ISSET(listenSock, &readSet)) {
+
+      sock = accept(listenSock, NULL, NULL);
+      if (sock == -1) {
+
+        printf("telnetd: failed to accept incoming connection.\n");
+        continue;
+      }
+
+      s = sessionAlloc();
+      if (s == NULL) {
+
+        sessionReject(sock);
+        continue;
+      }
+
+      sessionStart(&s->ctx, sock);
+      sessionPrompt(s);
+    }
+  }
+}
+
+#else
+
+static void tcpClientThread(void* arg)
+{
+  TelnetSession* s = (TelnetSession*)arg;
+  int sock = s->ctx.telnet.sock;
   struct timeval tv;
 
   tv.tv_sec = 60;
@@ -261,28 +869,20 @@ static void tcpClientThread(void* arg)
 
   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
-  memset(&ctx, '\0', sizeof(EshContext));
-  ctx.telnet.sock = sock;
-  ctx.output = telnetFunc;
-  ctx.input = inputFunc;
-  ctx.telnet.state  = STATE_NORMAL;
-  ctx.remote = true;
-
-  sendOpt(&ctx, TELNET_WILL, OPT_ECHO);
-
-  eshPrintf(&ctx, "Pico]OS " POS_VER_S "\n");
+  sessionStart(&s->ctx, sock);
   while (true) {
 
-    if (eshPrompt(&ctx, "esh> ", buf, sizeof(buf))) {
+    if (eshPrompt(&s->ctx, "esh> ", s->line, sizeof(s->line))) {
 
-      if (eshParse(&ctx, buf) == 0)
+      if (eshParse(&s->ctx, s->line) == 0)
         break;
     }
     else
       break;
   }
   
-  close(ctx.telnet.sock);
+  close(sock);
+  sessionFree(s);
 }
 
 static void telnetd(void* arg)
@@ -291,6 +891,7 @@ static void telnetd(void* arg)
   int sock;
   struct sockaddr_in peerAddr;
   socklen_t addrlen;
+  TelnetSession* s;
 
   for(;;) {
 
@@ -308,16 +909,49 @@ static void telnetd(void* arg)
 /*
  * Create thread to serve connection.
  */
-    if (nosTaskCreate(tcpClientThread, (void*)sock, 2, 3500, "telnetc") == NULL)
-       close(sock);
+    s = sessionAlloc();
+    if (s == NULL) {
+
+      sessionReject(sock);
+      continue;
+    }
+
+    s->ctx.telnet.sock = sock;
+    if (nosTaskCreate(tcpClientThread, (void*)s, 2, 3500, "telnetc") == NULL) {
+
+      close(sock);
+      sessionFree(s);
+    }
   }
 }
 
+#endif
+
+static int telnetdStatus(EshContext* ctx)
+{
+  eshPrintf(ctx, "%d/%d sessions in use, peak %d.\n", sessionsInUse, ESHELLCFG_TELNETD_SESSIONS, sessionsPeak);
+  eshPrintf(ctx, "%u accepted, %u rejected.\n", sessionsAccepted, sessionsRejected);
+  return 0;
+}
+
+const EshCommand eshTelnetdCommand = {
+  .flags = 0,
+  .name = "telnetd",
+  .help = "show telnet session pool",
+  .handler = telnetdStatus,
+  .args = eshNoArgs
+};
+
 void eshStartTelnetd()
 {
   int sock;
   struct sockaddr_in myAddr;
   int status;
+#if ESHELLCFG_TELNETD_SELECT
+  int i;
+#endif
+
+  eshInitCommands();
 
   sock = socket(AF_INET, SOCK_STREAM, 0);
   if (sock == -1) {
@@ -343,6 +977,19 @@ void eshStartTelnetd()
     printf("telnetd: listen error.\n");
     return;
   }
+/*
+ * In select mode commands are executed by worker tasks,
+ * so they need same stack as per-session tasks.
+ */
+#if ESHELLCFG_TELNETD_SELECT
+  workSema = nosSemaCreate(0, 0, "telnetw");
+  for (i = 0; i < ESHELLCFG_TELNETD_WORKERS; i++)
+    if (nosTaskCreate(telnetWorker, NULL, 2, 3500, "telnetw") == NULL)
+      fprintf(stderr, "telnetd: failed to create worker.\n");
+    else
+      ++workers;
+#endif
+
   if (nosTaskCreate(telnetd, (void*)sock, 2, 1500, "telnetd") == NULL) {
 
     close(sock);
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tests for argument schema validation in eshParse.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+
+enum {
+  TEST_ARG_COUNT,
+  TEST_ARG_VERBOSE,
+  TEST_ARG_ADDR,
+  TEST_ARG_NAME,
+  TEST_ARG_REST
+};
+
+static const EshArgSpec testArgs[] = {
+
+  { .name = "count", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 100, .def = 5, .help = "count" },
+  { .name = "verbose", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "verbose" },
+  { .name = "addr", .type = EshArgIp4, .flags = ESH_ARG_NAMED, .help = "address" },
+  { .name = "name", .type = EshArgString, .flags = ESH_ARG_REQUIRED, .help = "name" },
+  { .name = "rest", .type = EshArgString, .flags = ESH_ARG_LIST, .help = "more" },
+  { .name = NULL }
+};
+
+/*
+ * Schema with one entry more than fits into ctx->values.
+ */
+#define BIG_ARG(n) { .name = "a" #n, .type = EshArgInt, .flags = ESH_ARG_NAMED, .help = "" }
+
+static const EshArgSpec bigArgs[] = {
+
+  BIG_ARG(0), BIG_ARG(1), BIG_ARG(2), BIG_ARG(3), BIG_ARG(4), BIG_ARG(5),
+  BIG_ARG(6), BIG_ARG(7), BIG_ARG(8), BIG_ARG(9), BIG_ARG(10), BIG_ARG(11),
+  BIG_ARG(12), BIG_ARG(13), BIG_ARG(14), BIG_ARG(15), BIG_ARG(16),
+  { .name = NULL }
+};
+
+static int calls;
+static EshArgValue seen[MAX_ARG_SPECS];
+
+static int handler(EshContext* ctx)
+{
+  calls++;
+  memcpy(seen, ctx->values, sizeof(seen));
+  return 0;
+}
+
+static const EshCommand testCommand = {
+
+  .flags = 0,
+  .name = "t",
+  .help = "test",
+  .handler = handler,
+  .args = testArgs
+};
+
+static const EshCommand bigCommand = {
+
+  .flags = 0,
+  .name = "big",
+  .help = "test",
+  .handler = handler,
+  .args = bigArgs
+};
+
+const EshCommand* eshCommandList[] = {
+
+  &testCommand,
+  &bigCommand,
+  NULL
+};
+
+static char output[1024];
+
+static void outputFunc(EshContext* ctx, const char* str)
+{
+  strncat(output, str, sizeof(output) - strlen(output) - 1);
+}
+
+static int failures;
+
+/*
+ * Parse line and check status, whether handler
+ * was called and that output contains expected text.
+ */
+static void check(const char* line, EshStatus status, bool called, const char* text)
+{
+  EshContext ctx;
+  char buf[80];
+
+  memset(&ctx, '\0', sizeof(ctx));
+  ctx.output = outputFunc;
+  output[0] = '\0';
+  calls = 0;
+
+  strcpy(buf, line);
+  eshParse(&ctx, buf);
+
+  if (ctx.error != status || (calls > 0) != called || (text && !strstr(output, text))) {
+
+    printf("FAIL %s: status %d calls %d output \"%s\"\n", line, ctx.error, calls, output);
+    failures++;
+  }
+  else
+    printf("ok   %s\n", line);
+}
+
+int main(int argc, char** argv)
+{
+  check("t x", EshOK, true, NULL);
+  if (seen[TEST_ARG_COUNT].num != 5 || seen[TEST_ARG_COUNT].present ||
+      seen[TEST_ARG_VERBOSE].num != 0 || strcmp(seen[TEST_ARG_NAME].str, "x") ||
+      seen[TEST_ARG_REST].present) {
+
+    printf("FAIL defaults\n");
+    failures++;
+  }
+
+  check("t --count=0x10 --verbose --addr=10.1.2.3 x y z", EshOK, true, NULL);
+  if (seen[TEST_ARG_COUNT].num != 16 || seen[TEST_ARG_VERBOSE].num != 1 ||
+      seen[TEST_ARG_ADDR].ip4 != 0x0A010203 || strcmp(seen[TEST_ARG_REST].str, "y")) {
+
+    printf("FAIL conversion\n");
+    failures++;
+  }
+
+  check("t --verbose=no x", EshOK, true, NULL);
+  if (seen[TEST_ARG_VERBOSE].num != 0) {
+
+    printf("FAIL bool\n");
+    failures++;
+  }
+
+  check("t --colour=red x", EshUnknownArg, false, "--colour");
+  check("t --count=1 --count=2 x", EshDuplicateArg, false, "count");
+  check("t", EshMissingArg, false, "missing");
+  check("t --count=101 x", EshBadArg, false, "between 1 and 100");
+  check("t --count=0 x", EshBadArg, false, "between 1 and 100");
+  check("t --count=ten x", EshBadArg, false, "not a number");
+  check("t --count= x", EshBadArg, false, "missing argument value");
+  check("t --addr=10.1.2 x", EshBadArg, false, "not an ip4 address");
+  check("t --addr=10.1.2.256 x", EshBadArg, false, "not an ip4 address");
+  check("t --verbose=maybe x", EshBadArg, false, "not a boolean");
+  check("big --a0=1", EshBadArg, false, "too many arguments in schema");
+  check("t --help", EshOK, false, "--count=<int>");
+
+  return failures ? 1 : 0;
+}
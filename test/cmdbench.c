@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for command lookup. Same set of lines is parsed
+ * with command lists of different sizes. Each size is run
+ * in its own process, as command index is built only once.
+ * Lookup cost must stay roughly flat, linear search would
+ * make 1000 commands about hundred times slower than 10.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "eshell.h"
+
+#define MAX_COMMANDS 1000
+#define LOOKUPS      200000
+
+/*
+ * Allowed slowdown from smallest to largest list.
+ */
+#define MAX_RATIO    4.0
+
+const EshCommand* eshCommandList[MAX_COMMANDS + 1];
+
+static EshCommand commands[MAX_COMMANDS];
+static char names[MAX_COMMANDS][16];
+static int hits;
+
+static int handler(EshContext* ctx)
+{
+  hits++;
+  return 0;
+}
+
+static void output(EshContext* ctx, const char* str)
+{
+}
+
+static double nsPerLookup(int count)
+{
+  EshContext ctx;
+  EshCommand cmd = { .flags = 0, .help = "", .handler = handler, .args = NULL };
+  struct timespec start;
+  struct timespec end;
+  char buf[32];
+  int i;
+
+  for (i = 0; i < count; i++) {
+
+    snprintf(names[i], sizeof(names[i]), "cmd%04d", (i * 7919) % count);
+    cmd.name = names[i];
+    memcpy(&commands[i], &cmd, sizeof(cmd));
+    eshCommandList[i] = &commands[i];
+  }
+
+  eshCommandList[count] = NULL;
+
+  memset(&ctx, '\0', sizeof(ctx));
+  ctx.output = output;
+  eshInitCommands();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < LOOKUPS; i++) {
+
+    snprintf(buf, sizeof(buf), "cmd%04d", i % count);
+    eshParse(&ctx, buf);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (hits != LOOKUPS)
+    return -1;
+
+  return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / LOOKUPS;
+}
+
+/*
+ * Run one size in child process, result comes back through pipe.
+ */
+static double measure(int count)
+{
+  int fd[2];
+  double ns = -1;
+
+  if (pipe(fd) < 0)
+    return -1;
+
+  if (fork() == 0) {
+
+    ns = nsPerLookup(count);
+    if (write(fd[1], &ns, sizeof(ns)) != sizeof(ns))
+      _exit(1);
+
+    _exit(0);
+  }
+
+  close(fd[1]);
+  if (read(fd[0], &ns, sizeof(ns)) != sizeof(ns))
+    ns = -1;
+
+  close(fd[0]);
+  wait(NULL);
+  return ns;
+}
+
+int main(int argc, char** argv)
+{
+  static const int sizes[] = { 10, 100, 1000 };
+  double ns[3];
+  int i;
+
+  for (i = 0; i < 3; i++) {
+
+    ns[i] = measure(sizes[i]);
+    if (ns[i] < 0) {
+
+      printf("%4d commands: lookup failed\n", sizes[i]);
+      return 1;
+    }
+
+    printf("%4d commands: %.1f ns per line\n", sizes[i], ns[i]);
+  }
+
+  if (ns[2] > ns[0] * MAX_RATIO) {
+
+    printf("lookup cost grows with command count.\n");
+    return 1;
+  }
+
+  return 0;
+}
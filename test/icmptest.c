@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tests for ping and traceroute. Test runs in its own
+ * network namespace, where kernel doesn't answer echo
+ * requests. Responder task plays the network instead:
+ * it answers probes with time exceeded messages from
+ * routers 127.0.0.11, 127.0.0.12, ... until TEST_HOPS is
+ * reached, except for TEST_SILENT_HOP, which doesn't answer.
+ * It also sends unrelated ICMP traffic all the time, which
+ * must not extend reply timeouts. Needs root, test is
+ * skipped otherwise.
+ */
+
+#define _GNU_SOURCE
+
+#include <picoos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+
+#include "eshell.h"
+#include <picoos-lwip.h>
+#include <lwip/icmp.h>
+#include <lwip/inet_chksum.h>
+#include <lwip/ip4.h>
+#include "eshell-commands.h"
+
+#define TEST_HOPS       3
+#define TEST_SILENT_HOP 2
+#define TEST_NOISE      20000
+
+#define TEST_TARGET     "127.0.0.1"
+#define TEST_DEAD       "127.0.0.2"
+
+#define SKIP            77
+
+const EshCommand* eshCommandList[] = { &eshPingCommand, &eshTracerouteCommand, NULL };
+
+static char output[4096];
+static int failures;
+
+static void outputFunc(EshContext* ctx, const char* str)
+{
+  strncat(output, str, sizeof(output) - strlen(output) - 1);
+}
+
+/*
+ * Run command line, return elapsed time in ms.
+ */
+static uint32_t run(EshContext* ctx, const char* line)
+{
+  char buf[80];
+  uint32_t start;
+
+  memset(ctx, '\0', sizeof(*ctx));
+  ctx->output = outputFunc;
+  output[0] = '\0';
+
+  strcpy(buf, line);
+  start = eshMicros();
+  eshParse(ctx, buf);
+  return (eshMicros() - start) / 1000;
+}
+
+static void check(const char* what, bool ok)
+{
+  printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+  if (!ok) {
+
+    printf("%s", output);
+    failures++;
+  }
+}
+
+/*
+ * Private network namespace with loopback up and
+ * kernel echo replies disabled.
+ */
+static bool netSetup(void)
+{
+  struct ifreq ifr;
+  int s;
+  int fd;
+
+  if (unshare(CLONE_NEWNET) == -1)
+    return false;
+
+  s = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&ifr, '\0', sizeof(ifr));
+  strcpy(ifr.ifr_name, "lo");
+  if (ioctl(s, SIOCGIFFLAGS, &ifr) == -1)
+    return false;
+
+  ifr.ifr_flags |= IFF_UP;
+  if (ioctl(s, SIOCSIFFLAGS, &ifr) == -1)
+    return false;
+
+  close(s);
+  fd = open("/proc/sys/net/ipv4/icmp_echo_ignore_all", O_WRONLY);
+  if (fd == -1 || write(fd, "1", 1) != 1)
+    return false;
+
+  close(fd);
+  return true;
+}
+
+/*
+ * Send ICMP message with given source address.
+ */
+static void icmpSend(int s, const char* src, const char* dst, const void* icmp, int len)
+{
+  uint8_t pkt[200];
+  struct ip_hdr* ip = (struct ip_hdr*)pkt;
+  struct icmp_echo_hdr* hdr = (struct icmp_echo_hdr*)(pkt + sizeof(struct ip_hdr));
+  struct sockaddr_in to;
+
+  memset(pkt, '\0', sizeof(struct ip_hdr));
+  ip->_v_hl = 0x45;
+  ip->_len = htons(sizeof(struct ip_hdr) + len);
+  ip->_ttl = 64;
+  ip->_proto = IPPROTO_ICMP;
+  ip->src = inet_addr(src);
+  ip->dest = inet_addr(dst);
+
+  memcpy(hdr, icmp, len);
+  hdr->chksum = 0;
+  hdr->chksum = inet_chksum(hdr, len);
+
+  memset(&to, '\0', sizeof(to));
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = ip->dest;
+  sendto(s, pkt, sizeof(struct ip_hdr) + len, 0, (struct sockaddr*)&to, sizeof(to));
+}
+
+/*
+ * Port unreachable for some UDP packet. Both
+ * ping and traceroute must ignore it.
+ */
+static void sendNoise(int s)
+{
+  uint8_t msg[sizeof(struct icmp_echo_hdr) + sizeof(struct ip_hdr) + 8];
+  struct icmp_echo_hdr* hdr = (struct icmp_echo_hdr*)msg;
+  struct ip_hdr* ip = (struct ip_hdr*)(msg + sizeof(struct icmp_echo_hdr));
+
+  memset(msg, '\0', sizeof(msg));
+  hdr->type = ICMP_DUR;
+  hdr->code = 3;
+  ip->_v_hl = 0x45;
+  ip->_ttl = 1;
+  ip->_proto = IPPROTO_UDP;
+  ip->src = inet_addr(TEST_TARGET);
+  ip->dest = inet_addr("127.0.0.50");
+
+  icmpSend(s, "127.0.0.50", TEST_TARGET, msg, sizeof(msg));
+}
+
+static void answer(int s, uint8_t* pkt, int len)
+{
+  struct ip_hdr* ip = (struct ip_hdr*)pkt;
+  int hl = IPH_HL(ip) * 4;
+  struct icmp_echo_hdr* req = (struct icmp_echo_hdr*)(pkt + hl);
+  uint8_t msg[sizeof(struct icmp_echo_hdr) + 60 + 8];
+  char router[16];
+  int ttl = IPH_TTL(ip);
+
+  if (ip->dest != inet_addr(TEST_TARGET))
+    return;
+
+  if (ttl >= TEST_HOPS) {
+
+    req->type = ICMP_ER;
+    icmpSend(s, TEST_TARGET, TEST_TARGET, req, len - hl);
+    return;
+  }
+
+  if (ttl == TEST_SILENT_HOP)
+    return;
+
+/*
+ * Time exceeded quotes IP header and
+ * first 8 bytes of probe.
+ */
+  memset(msg, '\0', sizeof(struct icmp_echo_hdr));
+  msg[0] = ICMP_TE;
+  memcpy(msg + sizeof(struct icmp_echo_hdr), pkt, hl + 8);
+  sprintf(router, "127.0.0.%d", 10 + ttl);
+  icmpSend(s, router, TEST_TARGET, msg, sizeof(struct icmp_echo_hdr) + hl + 8);
+}
+
+static void responder(void* arg)
+{
+  uint8_t pkt[1500];
+  struct ip_hdr* ip = (struct ip_hdr*)pkt;
+  struct timeval tv;
+  uint32_t noise;
+  int rs;
+  int ws;
+  int len;
+
+  rs = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+  ws = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+
+  tv.tv_sec = 0;
+  tv.tv_usec = TEST_NOISE / 4;
+  setsockopt(rs, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  noise = eshMicros();
+  for(;;) {
+
+    if (eshMicros() - noise >= TEST_NOISE) {
+
+      sendNoise(ws);
+      noise = eshMicros();
+    }
+
+    len = recv(rs, pkt, sizeof(pkt), 0);
+    if (len < (int)sizeof(struct ip_hdr) || len < IPH_HL(ip) * 4 + (int)sizeof(struct icmp_echo_hdr))
+      continue;
+
+    if (pkt[IPH_HL(ip) * 4] == ICMP_ECHO)
+      answer(ws, pkt, len);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  EshContext ctx;
+  uint32_t ms;
+
+  if (!netSetup()) {
+
+    printf("skip: network namespace needs root\n");
+    return SKIP;
+  }
+
+  nosTaskCreate(responder, NULL, 2, 0, "responder");
+  posTaskSleep(MS(100));
+
+  ms = run(&ctx, "ping --count=3 --interval=50 --timeout=300 " TEST_TARGET);
+  check("ping replies", strstr(output, "3 sent, 3 received") != NULL);
+
+/*
+ * Noise arrives more often than timeout, so waiting
+ * must be bounded by deadline, not by socket timeout.
+ */
+  ms = run(&ctx, "ping --count=2 --interval=1 --timeout=300 " TEST_DEAD);
+  check("ping timeout with other icmp traffic",
+        strstr(output, "2 sent, 0 received") != NULL && ms >= 550 && ms < 1200);
+
+  ms = run(&ctx, "traceroute --probes=2 --max-hops=8 --timeout=300 " TEST_TARGET);
+  check("time exceeded from first router", strstr(output, "  1  127.0.0.11      2/2") != NULL);
+  check("silent router", strstr(output, "  2  *\n") != NULL);
+  check("echo reply from target", strstr(output, "  3  127.0.0.1       2/2") != NULL);
+  check("stops at target", strstr(output, "  4  ") == NULL);
+  check("silent hop bounded by timeout", ms >= 250 && ms < 1000);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tests for netperf client and server tasks against
+ * local peers. Client must be stoppable even if peer
+ * doesn't read anything.
+ */
+
+#include <picoos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+#include <picoos-lwip.h>
+#include "eshell-commands.h"
+
+#define TEST_PORT    15001
+#define STALLED_PORT 15002
+
+const EshCommand* eshCommandList[] = { &eshNetperfCommand, NULL };
+
+static char output[4096];
+static int failures;
+
+static void outputFunc(EshContext* ctx, const char* str)
+{
+  strncat(output, str, sizeof(output) - strlen(output) - 1);
+}
+
+static void run(EshContext* ctx, const char* line)
+{
+  char buf[80];
+
+  memset(ctx, '\0', sizeof(*ctx));
+  ctx->output = outputFunc;
+  output[0] = '\0';
+
+  strcpy(buf, line);
+  eshParse(ctx, buf);
+}
+
+static void check(const char* what, bool ok)
+{
+  printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+  if (!ok) {
+
+    printf("%s", output);
+    failures++;
+  }
+}
+
+/*
+ * Wait until status shows both tasks idle.
+ */
+static bool waitIdle(EshContext* ctx, int ms)
+{
+  while (ms > 0) {
+
+    run(ctx, "netperf --status");
+    if (strstr(output, "server: idle") && strstr(output, "client: idle"))
+      return true;
+
+    posTaskSleep(MS(100));
+    ms -= 100;
+  }
+
+  return false;
+}
+
+int main(int argc, char** argv)
+{
+  EshContext ctx;
+  struct sockaddr_in addr;
+  int size = 4096;
+  int s;
+  int i;
+
+/*
+ * Client and server in same process.
+ */
+  run(&ctx, "netperf --server --interval=0 --port=15001");
+  posTaskSleep(MS(200));
+  run(&ctx, "netperf --time=1 --interval=0 --port=15001 127.0.0.1");
+  check("tcp client run", strstr(output, "total") != NULL);
+
+/*
+ * Server sees end of connection a bit later.
+ */
+  for (i = 0; i < 10; i++) {
+
+    run(&ctx, "netperf --status");
+    if (strstr(output, "total"))
+      break;
+
+    posTaskSleep(MS(100));
+  }
+
+  check("server report", strstr(output, "total") != NULL);
+
+  run(&ctx, "netperf --stop");
+  check("server stops", waitIdle(&ctx, 2000));
+
+/*
+ * Peer that accepts connection but never reads. Client
+ * send buffer fills up, --stop must still work.
+ */
+  s = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  memset(&addr, '\0', sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(STALLED_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(s, 1) == -1) {
+
+    printf("FAIL cannot listen on port %d\n", STALLED_PORT);
+    return 1;
+  }
+
+  run(&ctx, "netperf --time=60 --interval=1 --background --port=15002 127.0.0.1");
+  posTaskSleep(MS(2500));
+
+  run(&ctx, "netperf --status");
+  check("interval reports from stalled client", strstr(output, "client: running") && strstr(output, "Mbit/s"));
+
+  run(&ctx, "netperf --stop");
+  check("stalled client stops", waitIdle(&ctx, 2000));
+
+  closesocket(s);
+  return failures ? 1 : 0;
+}
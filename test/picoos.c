@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host implementation of pico]OS calls in picoos.h.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "picoos.h"
+
+typedef struct {
+
+  POSTASKFUNC_t func;
+  void*         arg;
+
+} HostTask;
+
+volatile JIF_t jiffies;
+
+static pthread_mutex_t schedLock = PTHREAD_MUTEX_INITIALIZER;
+
+void posTaskSleep(JIF_t ticks)
+{
+  struct timespec ts;
+
+  ts.tv_sec = ticks / HZ;
+  ts.tv_nsec = (ticks % HZ) * (1000000000 / HZ);
+  nanosleep(&ts, NULL);
+  jiffies += ticks;
+}
+
+void posTaskSchedLock()
+{
+  pthread_mutex_lock(&schedLock);
+}
+
+void posTaskSchedUnlock()
+{
+  pthread_mutex_unlock(&schedLock);
+}
+
+static void* taskMain(void* arg)
+{
+  HostTask task = *(HostTask*)arg;
+
+  free(arg);
+  task.func(task.arg);
+  return NULL;
+}
+
+POSTASK_t nosTaskCreate(POSTASKFUNC_t func, void* arg, int prio, int stack, const char* name)
+{
+  HostTask* task;
+  pthread_t thread;
+
+  task = malloc(sizeof(HostTask));
+  if (task == NULL)
+    return NULL;
+
+  task->func = func;
+  task->arg = arg;
+  if (pthread_create(&thread, NULL, taskMain, task) != 0) {
+
+    free(task);
+    return NULL;
+  }
+
+  pthread_detach(thread);
+  return (POSTASK_t)task;
+}
+
+void* nosMemAlloc(unsigned int size)
+{
+  return malloc(size);
+}
+
+void nosMemFree(void* p)
+{
+  free(p);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Minimal pico]OS API for host tests. Tasks are
+ * threads and scheduler lock is a global mutex.
+ */
+
+#ifndef _PICOOS_H
+#define _PICOOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#define POS_VER_S "host"
+
+#define HZ    1000
+#define MS(x) ((x) * HZ / 1000)
+
+typedef unsigned long JIF_t;
+typedef void* POSTASK_t;
+typedef void (*POSTASKFUNC_t)(void* arg);
+
+extern volatile JIF_t jiffies;
+
+void      posTaskSleep(JIF_t ticks);
+void      posTaskSchedLock(void);
+void      posTaskSchedUnlock(void);
+POSTASK_t nosTaskCreate(POSTASKFUNC_t func, void* arg, int prio, int stack, const char* name);
+void*     nosMemAlloc(unsigned int size);
+void      nosMemFree(void* p);
+
+#endif
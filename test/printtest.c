@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Tests for eshPrintf output buffering. Output must match
+ * printf and long output must arrive intact, in
+ * buffer-sized pieces.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+
+const EshCommand* eshCommandList[] = { NULL };
+
+static char output[4096];
+static int outputCalls;
+static int maxPiece;
+
+static void outputFunc(EshContext* ctx, const char* str)
+{
+  int len = strlen(str);
+
+  outputCalls++;
+  if (len > maxPiece)
+    maxPiece = len;
+
+  strncat(output, str, sizeof(output) - strlen(output) - 1);
+}
+
+static int failures;
+
+static void reset(EshContext* ctx)
+{
+  memset(ctx, '\0', sizeof(*ctx));
+  ctx->output = outputFunc;
+  output[0] = '\0';
+  outputCalls = 0;
+  maxPiece = 0;
+}
+
+static void compare(const char* what, const char* expected)
+{
+  if (strcmp(output, expected)) {
+
+    printf("FAIL %s: got \"%s\" expected \"%s\"\n", what, output, expected);
+    failures++;
+  }
+  else
+    printf("ok   %s\n", what);
+}
+
+#define CHECK(...) do {                         \
+  char expected_[256];                          \
+  reset(&ctx);                                  \
+  eshPrintf(&ctx, __VA_ARGS__);                 \
+  eshFlush(&ctx);                               \
+  snprintf(expected_, sizeof(expected_), __VA_ARGS__); \
+  compare(#__VA_ARGS__, expected_);             \
+} while (0)
+
+int main(int argc, char** argv)
+{
+  EshContext ctx;
+  char longStr[1001];
+  int i;
+
+  CHECK("plain text\n");
+  CHECK("%d %i %u %x %X %o %%", -42, 17, 3000000000U, 0xbeef, 0xbeef, 8);
+  CHECK("[%5d] [%-5d] [%05d] [%+d] [% d]", 42, 42, 42, 42, 42);
+  CHECK("[%*d] [%-*d] [%.*d]", 6, 1, 6, 2, 4, 3);
+  CHECK("%ld %lu %lld %llu %zu", -1L, 2UL, -3LL, 4ULL, (size_t)5);
+  CHECK("%hhu %hd", 300, 70000);
+  CHECK("%c%c%c", 'a', 'b', 'c');
+  CHECK("[%s] [%10s] [%-10s] [%.3s] [%*.*s]", "abc", "abc", "abc", "abcdef", 8, 2, "xyz");
+  CHECK("%08X %p", 0x1234, (void*)&ctx);
+  CHECK("%.2f %e %g %1.1f", 3.14159, 1e10, 0.5, -0.25);
+
+/*
+ * String longer than output buffer.
+ */
+  for (i = 0; i < 1000; i++)
+    longStr[i] = 'a' + i % 26;
+
+  longStr[1000] = '\0';
+  reset(&ctx);
+  eshPrintf(&ctx, "<%s>", longStr);
+  eshFlush(&ctx);
+  if (strlen(output) != 1002 || strncmp(output + 1, longStr, 1000) || maxPiece >= ESHELLCFG_OUTPUT_BUFFER) {
+
+    printf("FAIL long string: %d bytes, largest piece %d\n", (int)strlen(output), maxPiece);
+    failures++;
+  }
+  else
+    printf("ok   long string in %d pieces\n", outputCalls);
+
+/*
+ * Listing with several fragments per row should result
+ * in about one transport call per buffer.
+ */
+  reset(&ctx);
+  for (i = 0; i < 30; i++) {
+
+    eshPrintf(&ctx, "%08X %-16s", 0x20001000 + i * 0x100, "task");
+    eshPrintf(&ctx, " %6u %6u %3u%%\n", 1024, 512, 50);
+  }
+
+  eshFlush(&ctx);
+  printf("%s 30 row listing, %d output calls\n", outputCalls <= 30 * 55 / (ESHELLCFG_OUTPUT_BUFFER - 1) + 1 ? "ok  " : "FAIL", outputCalls);
+  if (outputCalls > 30 * 55 / (ESHELLCFG_OUTPUT_BUFFER - 1) + 1)
+    failures++;
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <picoos.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+#include "eshell-trace.h"
+
+#if ESHELLCFG_TRACE
+
+#include "eshell-commands.h"
+
+EshTrace eshTrace;
+
+enum {
+  TRACE_ARG_START,
+  TRACE_ARG_STOP,
+  TRACE_ARG_CLEAR,
+  TRACE_ARG_DUMP,
+  TRACE_ARG_RAW,
+  TRACE_ARG_COUNT
+};
+
+static const EshArgSpec traceArgs[] = {
+
+  { .name = "start", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "start recording" },
+  { .name = "stop", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "stop recording" },
+  { .name = "clear", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "discard recorded events" },
+  { .name = "dump", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "show recorded events" },
+  { .name = "raw", .type = EshArgBool, .flags = ESH_ARG_NAMED, .help = "dump as hex records for offline decoding" },
+  { .name = "count", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = ESHELLCFG_TRACE_SIZE, .def = ESHELLCFG_TRACE_SIZE, .help = "dump only newest records" },
+  { .name = NULL }
+};
+
+/*
+ * Arguments are only 32 bits, so command pointer
+ * is looked up from command list instead of
+ * dereferencing it.
+ */
+static const char* traceCommand(uint32_t arg)
+{
+  const EshCommand** cmd;
+
+  for (cmd = eshCommandList; *cmd != NULL; cmd++)
+    if ((uint32_t)(uintptr_t)*cmd == arg)
+      return (*cmd)->name;
+
+  return "?";
+}
+
+static void traceDecode(EshContext* ctx, const EshTraceRecord* rec)
+{
+  switch (rec->id) {
+  case ESH_TRACE_SWITCH:
+    eshPrintf(ctx, "switch    %08X\n", rec->arg1);
+    break;
+
+  case ESH_TRACE_CMD_START:
+    eshPrintf(ctx, "cmd start %s\n", traceCommand(rec->arg1));
+    break;
+
+  case ESH_TRACE_CMD_END:
+    eshPrintf(ctx, "cmd end   %s = %d\n", traceCommand(rec->arg1), (int)rec->arg2);
+    break;
+
+  default:
+    eshPrintf(ctx, "%-9X %08X %08X\n", rec->id, rec->arg1, rec->arg2);
+    break;
+  }
+}
+
+/*
+ * Dump newest records, oldest first. Recording is paused
+ * meanwhile, so that records are not overwritten
+ * while they are printed.
+ */
+static void traceDump(EshContext* ctx, bool raw, uint32_t count)
+{
+  const EshTraceRecord* rec;
+  uint32_t head;
+  uint32_t prev;
+  uint32_t i;
+  bool enabled;
+
+  enabled = eshTrace.enabled;
+  eshTrace.enabled = false;
+
+  head = eshTrace.head;
+  if (count > head)
+    count = head;
+
+  if (count > ESHELLCFG_TRACE_SIZE)
+    count = ESHELLCFG_TRACE_SIZE;
+
+  if (raw)
+    eshPrintf(ctx, "# eshell trace %u records: stamp id arg1 arg2\n", count);
+  else
+    eshPrintf(ctx, "%10s %8s  %s\n", "stamp", "delta", "event");
+
+  prev = 0;
+  for (i = head - count; i != head && !eshCancelled(ctx); i++) {
+
+    rec = &eshTrace.buf[i & (ESHELLCFG_TRACE_SIZE - 1)];
+    if (raw) {
+
+      eshPrintf(ctx, "%08X %08X %08X %08X\n", rec->stamp, rec->id, rec->arg1, rec->arg2);
+      continue;
+    }
+
+    eshPrintf(ctx, "%10u %8u  ", rec->stamp, i == head - count ? 0 : rec->stamp - prev);
+    traceDecode(ctx, rec);
+    prev = rec->stamp;
+  }
+
+  eshTrace.enabled = enabled;
+}
+
+static int trace(EshContext* ctx)
+{
+  bool done = false;
+  bool enabled;
+  uint32_t head;
+
+  if (ctx->values[TRACE_ARG_STOP].num) {
+
+    eshTrace.enabled = false;
+    done = true;
+  }
+
+/*
+ * Recording is paused while buffer is cleared, like
+ * during dump, so that new records don't race with reset.
+ */
+  if (ctx->values[TRACE_ARG_CLEAR].num) {
+
+    enabled = eshTrace.enabled;
+    eshTrace.enabled = false;
+    eshTrace.head = 0;
+    memset(eshTrace.buf, '\0', sizeof(eshTrace.buf));
+    eshTrace.enabled = enabled;
+    done = true;
+  }
+
+  if (ctx->values[TRACE_ARG_DUMP].num || ctx->values[TRACE_ARG_RAW].num) {
+
+    traceDump(ctx, ctx->values[TRACE_ARG_RAW].num, ctx->values[TRACE_ARG_COUNT].num);
+    done = true;
+  }
+
+  if (ctx->values[TRACE_ARG_START].num) {
+
+    eshTrace.enabled = true;
+    done = true;
+  }
+
+  if (!done) {
+
+    head = eshTrace.head;
+    eshPrintf(ctx, "trace %s, %u events recorded, %u kept, %d conf max.\n",
+              eshTrace.enabled ? "running" : "stopped",
+              head, head < ESHELLCFG_TRACE_SIZE ? head : ESHELLCFG_TRACE_SIZE,
+              ESHELLCFG_TRACE_SIZE);
+  }
+
+  return 0;
+}
+
+const EshCommand eshTraceCommand = {
+  .flags = 0,
+  .name = "trace",
+  .help = "record events into trace buffer",
+  .handler = trace,
+  .args = traceArgs
+};
+
+#endif
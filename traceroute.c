@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2019, Ari Suutari <ari@stonepile.fi>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. The name of the author may not be used to endorse or promote
+ *     products derived from this software without specific prior written
+ *     permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT,  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <picoos.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "eshell.h"
+
+#if ESHELLCFG_LWIP
+
+#include <picoos-lwip.h>
+
+#if LWIP_RAW
+
+#include <lwip/icmp.h>
+#include <lwip/inet_chksum.h>
+#include <lwip/ip4.h>
+#include "eshell-commands.h"
+#include "eshell-ping.h"
+
+/*
+ * Probes per hop are sent together and share
+ * one timeout. Sequence number is ttl * TRACE_MAX_PROBES + probe,
+ * so replies to earlier hops are easy to reject.
+ */
+#define TRACE_MAX_PROBES 8
+#define TRACE_SIZE       32
+
+enum {
+  TRACE_ARG_PROBES,
+  TRACE_ARG_MAX_HOPS,
+  TRACE_ARG_TIMEOUT,
+  TRACE_ARG_HOST
+};
+
+static const EshArgSpec traceArgs[] = {
+
+  { .name = "probes", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = TRACE_MAX_PROBES, .def = 3, .help = "probes per hop" },
+  { .name = "max-hops", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 255, .def = 30, .help = "largest ttl" },
+  { .name = "timeout", .type = EshArgInt, .flags = ESH_ARG_NAMED, .min = 1, .max = 60000, .def = 1000, .help = "reply timeout ms" },
+  { .name = "host", .type = EshArgString, .flags = ESH_ARG_REQUIRED, .help = "host name or address" },
+  { .name = NULL }
+};
+
+typedef struct {
+
+  struct in_addr addr;
+  int      replies;
+  uint8_t  replied;
+  uint32_t min;
+  uint32_t max;
+  uint32_t sum;
+  bool     others;
+  bool     reached;
+  bool     unreachable;
+
+} TraceHop;
+
+/*
+ * Receive next reply to a probe. Echo replies come from
+ * destination itself, time exceeded and unreachable
+ * messages from routers along the path. Those quote the
+ * IP header and first 8 bytes of the original probe,
+ * which is enough to get id and sequence number.
+ * Returns false if nothing arrives before deadline. Socket
+ * timeout is shortened before each receive, so that other
+ * traffic doesn't extend the wait.
+ */
+static bool traceReceiveAny(int s, uint32_t deadline, struct in_addr* from, uint8_t* type, uint16_t* id, uint16_t* seq)
+{
+  int len;
+  int off;
+  char buf[60 + sizeof(struct icmp_echo_hdr) + 60 + sizeof(PingPacket)];
+  struct icmp_echo_hdr *icmp;
+  struct icmp_echo_hdr *probe;
+
+  struct sockaddr_in fromAddr;
+  int fromlen;
+  struct ip_hdr *iphdr;
+  uint32_t now;
+
+  while (true) {
+
+    now = eshMicros();
+    if ((int32_t)(deadline - now) <= 0)
+      return false;
+
+    pingSetTimeout(s, deadline - now);
+    fromlen = sizeof(struct sockaddr_in);
+    len = recvfrom(s, buf, sizeof(buf), 0, (struct sockaddr *)&fromAddr, (socklen_t *) &fromlen);
+    if (len <= 0)
+      return false;
+
+    if (len < (int)sizeof(struct ip_hdr) || fromAddr.sin_family != AF_INET)
+      continue;
+
+    iphdr = (struct ip_hdr *)buf;
+    off = IPH_HL(iphdr) * 4;
+    if (len < off + (int)sizeof(struct icmp_echo_hdr))
+      continue;
+
+    icmp = (struct icmp_echo_hdr *)(buf + off);
+    if (icmp->type == ICMP_ER)
+      probe = icmp;
+    else if (icmp->type == ICMP_TE || icmp->type == ICMP_DUR) {
+
+      off += sizeof(struct icmp_echo_hdr);
+      if (len < off + (int)sizeof(struct ip_hdr))
+        continue;
+
+      iphdr = (struct ip_hdr *)(buf + off);
+      if (IPH_PROTO(iphdr) != IPPROTO_ICMP)
+        continue;
+
+      off += IPH_HL(iphdr) * 4;
+      if (len < off + (int)sizeof(struct icmp_echo_hdr))
+        continue;
+
+      probe = (struct icmp_echo_hdr *)(buf + off);
+      if (probe->type != ICMP_ECHO)
+        continue;
+    }
+    else
+      continue;
+
+    *from = fromAddr.sin_addr;
+    *type = icmp->type;
+    *id = probe->id;
+    *seq = ntohs(probe->seqno);
+    return true;
+  }
+}
+
+/*
+ * Send all probes for one hop and collect replies
+ * until each probe is answered or timeout expires.
+ */
+static bool traceHop(EshContext* ctx, int s, const struct sockaddr* to, int toLen,
+                     PingPacket* packet, int ttl, TraceHop* hop)
+{
+  int probes = ctx->values[TRACE_ARG_PROBES].num;
+  uint32_t timeout = ctx->values[TRACE_ARG_TIMEOUT].num * 1000;
+  uint32_t sent[TRACE_MAX_PROBES];
+  uint32_t deadline;
+  uint32_t rtt;
+  struct in_addr from;
+  uint8_t type;
+  uint16_t replyId;
+  uint16_t replySeq;
+  int i;
+
+  memset(hop, '\0', sizeof(TraceHop));
+  if (setsockopt(s, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl)) < 0) {
+
+    eshPrintf(ctx, "%s: cannot set ttl, error %d.\n", ctx->argv[0], errno);
+    return false;
+  }
+
+  for (i = 0; i < probes; i++) {
+
+    sent[i] = eshMicros();
+    if (pingSend(s, to, toLen, packet, TRACE_SIZE, ttl * TRACE_MAX_PROBES + i) < 0) {
+
+      eshPrintf(ctx, "%s: send failed.\n", ctx->argv[0]);
+      return false;
+    }
+  }
+
+  deadline = sent[0] + timeout;
+  while (hop->replies < probes) {
+
+    if (!traceReceiveAny(s, deadline, &from, &type, &replyId, &replySeq))
+      break;
+
+    if (replyId != packet->hdr.id || replySeq / TRACE_MAX_PROBES != ttl)
+      continue;
+
+    i = replySeq % TRACE_MAX_PROBES;
+    if (i >= probes || (hop->replied & (1 << i)))
+      continue;
+
+    rtt = eshMicros() - sent[i];
+    hop->replied |= (1 << i);
+
+    if (hop->replies == 0) {
+
+      hop->addr = from;
+      hop->min = rtt;
+    }
+    else if (hop->addr.s_addr != from.s_addr)
+      hop->others = true;
+
+    if (rtt < hop->min)
+      hop->min = rtt;
+
+    if (rtt > hop->max)
+      hop->max = rtt;
+
+    hop->sum += rtt;
+    hop->replies++;
+
+    if (type == ICMP_ER && from.s_addr == ((const struct sockaddr_in*)(const void*)to)->sin_addr.s_addr)
+      hop->reached = true;
+    else if (type == ICMP_DUR)
+      hop->unreachable = true;
+  }
+
+  return true;
+}
+
+static void tracePrint(EshContext* ctx, int ttl, const TraceHop* hop)
+{
+  eshPrintf(ctx, "%3d  ", ttl);
+  if (hop->replies == 0) {
+
+    eshPrintf(ctx, "*\n");
+    return;
+  }
+
+  eshPrintf(ctx, "%-15s %d/%d", inet_ntoa(hop->addr), hop->replies, ctx->values[TRACE_ARG_PROBES].num);
+  pingPrintMs(ctx, " ", hop->min);
+  pingPrintMs(ctx, "/", hop->sum / hop->replies);
+  pingPrintMs(ctx, "/", hop->max);
+  eshPrintf(ctx, " ms%s%s\n", hop->others ? " (multiple)" : "", hop->unreachable ? " !unreachable" : "");
+}
+
+static int traceroute(EshContext* ctx)
+{
+  char *host = ctx->values[TRACE_ARG_HOST].str;
+  int maxHops = ctx->values[TRACE_ARG_MAX_HOPS].num;
+  struct addrinfo *res;
+  PingPacket* packet;
+  TraceHop hop;
+  int ttl;
+  int s;
+
+  if (!pingResolve(ctx, host, &res))
+    return -1;
+
+  if ((s = pingSocket(ctx, ctx->values[TRACE_ARG_TIMEOUT].num * 1000)) < 0) {
+
+    freeaddrinfo(res);
+    return -1;
+  }
+
+  packet = pingAlloc(ctx, pingNextId(), TRACE_SIZE);
+  if (packet == NULL) {
+
+    closesocket(s);
+    freeaddrinfo(res);
+    return -1;
+  }
+
+  eshPrintf(ctx, "traceroute to %s (%s), %d hops max\n", host,
+            inet_ntoa(((struct sockaddr_in*)(void*)res->ai_addr)->sin_addr), maxHops);
+
+  for (ttl = 1; ttl <= maxHops && !eshCancelled(ctx); ttl++) {
+
+    if (!traceHop(ctx, s, res->ai_addr, res->ai_addrlen, packet, ttl, &hop))
+      break;
+
+    tracePrint(ctx, ttl, &hop);
+    eshFlush(ctx);
+
+    if (hop.reached || hop.unreachable)
+      break;
+  }
+
+  closesocket(s);
+  nosMemFree(packet);
+  freeaddrinfo(res);
+  return 0;
+}
+
+const EshCommand eshTracerouteCommand = {
+  .flags = 0,
+  .name = "traceroute",
+  .help = "show route to host",
+  .handler = traceroute,
+  .args = traceArgs
+};
+
+#endif
+#endif